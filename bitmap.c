@@ -1,15 +1,16 @@
-#include <cstdio>
-#include <cstdlib>
+#include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
-#include <cstdint>
+#include <stdint.h>
 #include "bitmap.h"
 
-static int count_bits(uint32_t num);
-static int find_first_set(uint32_t num);
+static int count_bits(bm_t num);
+static int find_first_set(bm_t num);
+static int select_bit(bm_t num, int n);
 
 bool bit_get(bm_t *bitmap, int index)
 {
-    return ((bitmap[index >> BM_OFST] & (1 << (index % BM_UNIT))) != 0);
+    return ((bitmap[index >> BM_OFST] & ((bm_t)1 << (index % BM_UNIT))) != 0);
 }
 
 void bit_set(bm_t *bitmap, int index)
@@ -19,7 +20,7 @@ void bit_set(bm_t *bitmap, int index)
 
 void bit_clr(bm_t *bitmap, int index)
 {
-    bitmap[index >> BM_OFST] &= ~(1 << (index % BM_UNIT));
+    bitmap[index >> BM_OFST] &= ~((bm_t)1 << (index % BM_UNIT));
 }
 
 int bit_count_ones(bm_t *bitmap, int index)
@@ -80,20 +81,20 @@ int bit_fns(bm_t *bitmap, int size, int n)
     }
     return -1;
 #else
-    int i, j, cnt;
-    cnt = 0;
-    for (i = 0; i < ((size + BM_UNIT - 1) >> BM_OFST); i++) {
-        cnt += count_bits(bitmap[i]);
-        if (cnt >= n) {
-            for (j = BM_UNIT - 1; j >= 0; j--) {
-                if (bitmap[i] & (1 << j)) {
-                    if (cnt == n) {
-                        return ((i << BM_OFST) + j);
-                    }
-                    cnt--;
-                }
-            }
+    int i, cnt;
+    int len;
+
+    if (n <= 0) {
+        return -1;
+    }
+    /* rank by whole words, then select inside the word holding the nth set */
+    len = ((size + BM_UNIT - 1) >> BM_OFST);
+    for (i = 0; i < len; i++) {
+        cnt = count_bits(bitmap[i]);
+        if (n <= cnt) {
+            return (i << BM_OFST) + select_bit(bitmap[i], n);
         }
+        n -= cnt;
     }
     return -1;
 #endif
@@ -135,47 +136,17 @@ void bit_clear_all(bm_t *bitmap, int size)
     }
 }
 
-int m2t_map(int x, int y, int m)
-{
-    if (x < y) {
-        return -1;
-    }
-    /* doesn't check to speed up the process */
-//    if ((x >= m) || (y >= m)) {
-//        return -1;
-//    }
-    return (y + 1) * (m + m - y) / 2 - (m - x);
-}
-
-bool m2t_get(bm_t *m2tbm, int x, int y, int m)
-{
-    if (x < y) {
-        return false;
-    }
-    return bit_get(m2tbm, (y + 1) * (m + m - y) / 2 - (m - x));
-}
-
-void m2t_set(bm_t *m2tbm, int x, int y, int m)
-{
-    if (x < y) {
-        return;
-    }
-    bit_set(m2tbm, (y + 1) * (m + m - y) / 2 - (m - x));
-}
-
-void m2t_clr(bm_t *m2tbm, int x, int y, int m)
-{
-    if (x < y) {
-        return;
-    }
-    bit_clr(m2tbm, (y + 1) * (m + m - y) / 2 - (m - x));
-}
-
+#ifndef BUILTIN_FUNC
 static const uint8_t num_to_bits[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
-static int count_bits(uint32_t num)
+#endif
+static int count_bits(bm_t num)
 {
 #ifdef BUILTIN_FUNC
+#if defined BM_8
+    return __builtin_popcountll(num);
+#else
     return __builtin_popcount(num);
+#endif
 #else
     if (0 == num) {
         return num_to_bits[0];
@@ -185,13 +156,44 @@ static int count_bits(uint32_t num)
 }
 
 int __rt_ffs(int value);
-static int find_first_set(uint32_t num)
+static int find_first_set(bm_t num)
 {
 #ifdef BUILTIN_FUNC
+#if defined BM_8
+    return __builtin_ffsll(num) - 1;
+#else
     return __builtin_ffs(num) - 1;
+#endif
 #else
-    return __rt_ffs(num) - 1;
+#if defined BM_8
+    if ((uint32_t)num == 0) {
+        return __rt_ffs((int)(num >> 32)) + 31;
+    }
 #endif
+    return __rt_ffs((int)(uint32_t)num) - 1;
+#endif
+}
+
+/* bit position of the nth (from 1) set bit of num, num holds at least n sets */
+static int select_bit(bm_t num, int n)
+{
+    int half, cnt, pos;
+
+    /* halve the search window with popcount down to one byte */
+    pos = 0;
+    for (half = BM_UNIT / 2; half >= 8; half >>= 1) {
+        cnt = count_bits(num & (((bm_t)1 << half) - 1));
+        if (n > cnt) {
+            n -= cnt;
+            num >>= half;
+            pos += half;
+        }
+    }
+    /* drop the lowest n - 1 sets of the last byte */
+    while (--n > 0) {
+        num &= num - 1;
+    }
+    return pos + find_first_set(num);
 }
 
 const uint8_t __lowest_bit_bitmap[] =
@@ -1,9 +1,21 @@
 #ifndef __BITMAP_H
 #define __BITMAP_H
 
-//#define BM_1
-//#define BM_2
-#define BM_1
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ bitmap word width, select one per target with -DBM_1/-DBM_2/-DBM_4/-DBM_8
+ (8, 16, 32 or 64 bits). Defaults to the native register width: 64-bit words
+ on 64-bit hosts, 32-bit words elsewhere (Cortex-M).
+ */
+#if !defined BM_1 && !defined BM_2 && !defined BM_4 && !defined BM_8
+#if defined __x86_64__ || defined __aarch64__ || defined _M_X64 || defined _M_ARM64
+#define BM_8
+#else
+#define BM_4
+#endif
+#endif
 #define BUILTIN_FUNC
 
 /*
@@ -30,7 +42,11 @@ But since there's no C/C++ functionality for them, they're only accessible via c
 
 */
 
-#if defined BM_4
+#if defined BM_8
+typedef uint64_t bm_t;
+#define BM_UNIT         (sizeof(bm_t) * 8)
+#define BM_OFST         (6) // 8: 3, 16: 4, 32: 5, 64: 6
+#elif defined BM_4
 typedef uint32_t bm_t;
 #define BM_UNIT         (sizeof(bm_t) * 8)
 #define BM_OFST         (5) // 8: 3, 16: 4, 32: 5
@@ -63,9 +79,71 @@ bool bit_is_all_clear(bm_t *bitmap, int size);
 
 void bit_clear_all(bm_t *bitmap, int size);
 
-inline int m2t_map(int x, int y, int m);
-inline bool m2t_get(bm_t *m2tbm, int x, int y, int m);
-inline void m2t_set(bm_t *m2tbm, int x, int y, int m);
-inline void m2t_clr(bm_t *m2tbm, int x, int y, int m);
+/*
+ m x m upper triangular bitmap, row y keeps bits y to m - 1. A row is stored
+ as a run of whole words, from the word holding bit y to the last word of
+ the row, so bit x of row y is bit x of m2t_row(m2tbm, y, m) and rows can be
+ copied and xored word by word. Compared with packing the bits, each row
+ takes at most one extra word.
+ */
+
+/*
+ words before row y, unsigned so that m up to 65535 fits; bit indexes
+ (m2t_map) stay below 2^31 up to m = 46340
+ */
+static inline uint32_t m2t_offset(uint32_t y, uint32_t m)
+{
+    uint32_t q, r;
+
+    q = y >> BM_OFST;
+    r = y & (BM_UNIT - 1);
+    /* y * words per row, less the leading words skipped by rows 0 to y - 1 */
+    return y * ((m + BM_UNIT - 1) >> BM_OFST) - (BM_UNIT * q * (q - 1) / 2 + q * r);
+}
+
+/* words taken by an m x m matrix */
+static inline uint32_t m2t_size(uint32_t m)
+{
+    return m2t_offset(m, m);
+}
+
+/* row y, valid from word y >> BM_OFST to the last word of the row */
+static inline bm_t *m2t_row(bm_t *m2tbm, int y, int m)
+{
+    return m2tbm + m2t_offset(y, m) - (y >> BM_OFST);
+}
+
+/* bit index of (x, y) in m2tbm, -1 below the diagonal */
+static inline int m2t_map(int x, int y, int m)
+{
+    if (x < y) {
+        return -1;
+    }
+    return (m2t_offset(y, m) - (y >> BM_OFST)) * BM_UNIT + x;
+}
+
+static inline bool m2t_get(bm_t *m2tbm, int x, int y, int m)
+{
+    if (x < y) {
+        return false;
+    }
+    return (m2t_row(m2tbm, y, m)[x >> BM_OFST] >> (x & (BM_UNIT - 1))) & 1;
+}
+
+static inline void m2t_set(bm_t *m2tbm, int x, int y, int m)
+{
+    if (x < y) {
+        return;
+    }
+    m2t_row(m2tbm, y, m)[x >> BM_OFST] |= (bm_t)1 << (x & (BM_UNIT - 1));
+}
+
+static inline void m2t_clr(bm_t *m2tbm, int x, int y, int m)
+{
+    if (x < y) {
+        return;
+    }
+    m2t_row(m2tbm, y, m)[x >> BM_OFST] &= ~((bm_t)1 << (x & (BM_UNIT - 1)));
+}
 
 #endif // __BITMAP_H
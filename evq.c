@@ -0,0 +1,47 @@
+#include <string.h>
+#include "evq.h"
+
+#define EVQ_MASK                (EVQ_LEN - 1)
+
+void evq_init(evq_t *q)
+{
+    memset(q, 0, sizeof(*q));
+}
+
+evq_ev_t *evq_alloc(evq_t *q)
+{
+    evq_ev_t *ev;
+
+    if ((uint8_t)(q->tail - q->head) >= EVQ_LEN) {
+        q->dropped++;
+        return NULL;
+    }
+    ev = &q->ev[q->tail & EVQ_MASK];
+    ev->len = 0;
+    return ev;
+}
+
+void evq_post(evq_t *q)
+{
+    q->tail++;
+}
+
+evq_ev_t *evq_peek(evq_t *q)
+{
+    if (q->head == q->tail) {
+        return NULL;
+    }
+    return &q->ev[q->head & EVQ_MASK];
+}
+
+void evq_pop(evq_t *q)
+{
+    if (q->head != q->tail) {
+        q->head++;
+    }
+}
+
+bool evq_empty(evq_t *q)
+{
+    return q->head == q->tail;
+}
@@ -0,0 +1,46 @@
+#ifndef __EVQ_H
+#define __EVQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Event queue between interrupt handlers and the main loop.
+
+ A ring of EVQ_LEN events, each with room for a received frame. The
+ producer side (evq_alloc, evq_post) runs in interrupt handlers, the
+ consumer side (evq_peek, evq_pop) in the main loop; with handlers of
+ different priorities the producer must mask interrupts around
+ evq_alloc ... evq_post. A full queue drops the event and counts it.
+ */
+
+#ifndef EVQ_LEN
+#define EVQ_LEN                 (8)     // power of 2
+#endif
+#define EVQ_DATA_LEN            (64)    // largest frame of the demo, FRAME_MAX_LEN of main.cpp
+
+typedef struct {
+    uint8_t type;
+    uint8_t len;
+    int16_t rssi;
+    int8_t snr;
+    uint8_t data[EVQ_DATA_LEN];
+} evq_ev_t;
+
+typedef struct {
+    evq_ev_t ev[EVQ_LEN];
+    volatile uint8_t head;      // next to handle, moved by the consumer
+    volatile uint8_t tail;      // next free, moved by the producer
+    volatile uint16_t dropped;
+} evq_t;
+
+void evq_init(evq_t *q);
+/* producer: slot for the next event, NULL when full, visible after evq_post */
+evq_ev_t *evq_alloc(evq_t *q);
+void evq_post(evq_t *q);
+/* consumer: oldest event, NULL when empty, released by evq_pop */
+evq_ev_t *evq_peek(evq_t *q);
+void evq_pop(evq_t *q);
+bool evq_empty(evq_t *q);
+
+#endif // __EVQ_H
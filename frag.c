@@ -6,6 +6,55 @@
 
 #define FRAG_COMPRESS_MATRIX_SIZE
 
+#ifdef FRAG_STATS
+#define FRAG_STAT(x)        x
+
+#if defined FRAG_STATS_CLOCK
+static void frag_cycles_init(void)
+{
+}
+
+static uint32_t frag_cycles(void)
+{
+    return FRAG_STATS_CLOCK();
+}
+#elif defined __ARM_ARCH_7M__ || defined __ARM_ARCH_7EM__ || defined __ARM_ARCH_8M_MAIN__
+#define FRAG_DEMCR          (*(volatile uint32_t *)0xE000EDFC)
+#define FRAG_DWT_CTRL       (*(volatile uint32_t *)0xE0001000)
+#define FRAG_DWT_CYCCNT     (*(volatile uint32_t *)0xE0001004)
+
+/* DWT cycle counter, left running once enabled */
+static void frag_cycles_init(void)
+{
+    FRAG_DEMCR |= 1UL << 24;    // TRCENA
+    FRAG_DWT_CTRL |= 1;         // CYCCNTENA
+}
+
+static uint32_t frag_cycles(void)
+{
+    return FRAG_DWT_CYCCNT;
+}
+#elif defined __linux__
+#include <time.h>
+
+static void frag_cycles_init(void)
+{
+}
+
+/* ns, wraps every 4.3 s, stages are measured by differences */
+static uint32_t frag_cycles(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+#else
+#error "no cycle counter for FRAG_STATS on this target, define FRAG_STATS_CLOCK()"
+#endif
+#else
+#define FRAG_STAT(x)
+#endif // FRAG_STATS
+
 static bool is_power2(uint32_t num)
 {
     return (num != 0) && ((num & (num-1)) == 0);
@@ -21,44 +70,13 @@ static uint32_t prbs23(uint32_t x)
     return (x >> 1) + ((b0 ^ b1) << 22);
 }
 
-/*
- @brief: returns line n of parity check matrix MxM
-n: FragIndex
-m: NubFrag
-buf: length is greater than m
-*/
-static int matrix_line(uint8_t *buf, int n, int m)
-{
-    int mm, x, nbCoeff, r;
-
-    /* Power of 2 tend to generate patterns so we make mm as 1 so that it is
-       as random as possible */
-    mm = 0;
-    if (is_power2(m)) {
-        mm = 1;
-    }
-    mm += m;
-
-    x = 1 + (1001 * n);// just so that each line n has a randomly generated seed
-
-    /* following loop generates a matrix line with m/2 bits set */
-    for (nbCoeff = 0; nbCoeff < (m/2); nbCoeff++) {
-        r = (1 << 16);
-        while (r >= m) {
-            x = prbs23(x);//generate random number till r fits in the matrix range
-            r = x % mm;
-        }
-        buf[r] = 1;//set a random bit
-    }
-
-    return 0;
-}
 /*
  n: index of the uncoded and coded fragmentations, maximum N - 1, starts from 0
  */
 static int matrix_line_bm(bm_t *bm, int n, int m)
 {
-    int mm, x, nbCoeff, r;
+    int mm, nbCoeff, r;
+    uint32_t x;
 
     bit_clear_all(bm, m);
 
@@ -76,138 +94,443 @@ static int matrix_line_bm(bm_t *bm, int n, int m)
     }
     mm += m;
 
-    x = 1 + (1001 * n);
+    x = 1 + (1001 * (uint32_t)n);
 
     for (nbCoeff = 0; nbCoeff < (m/2); nbCoeff++) {
-        r = (1 << 16);
-        while (r >= m) {
+        do {
             x = prbs23(x);
             r = x % mm;
-        }
+        } while (r >= m);
         bit_set(bm, r);
     }
 
     return 0;
 }
 
-static int buf_xor(uint8_t *des, uint8_t *src, int len)
+/*
+ buf: word aligned memory for the cache
+ len: length of buf
+ nb: number of uncoded fragments the cached rows belong to
+ rows: number of coded rows to cache, rows 1 to rows
+ return: used memory, or -1 if buf is too small or not aligned
+ */
+int frag_row_cache_init(frag_row_cache_t *rc, uint8_t *buf, uint32_t len, uint16_t nb, uint16_t rows)
 {
-    int i;
-    for (i = 0; i < len; i++) {
-        des[i] ^= src[i];
+    uint32_t i;
+
+    if (((uintptr_t)buf % sizeof(bm_t)) != 0) {
+        return -1;
+    }
+
+    rc->nb = nb;
+    rc->rows = rows;
+    rc->words = (nb + BM_UNIT - 1) / BM_UNIT;
+
+    i = 0;
+    rc->valid_bm = (bm_t *)(buf + i);
+    i += (rows + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t);
+    rc->row_bm = (bm_t *)(buf + i);
+    i += (uint32_t)rows * rc->words * sizeof(bm_t);
+    if (i > len) {
+        return -1;
+    }
+
+    bit_clear_all(rc->valid_bm, rows);
+    return i;
+}
+
+/* generate all rows so that the cache is never written again */
+void frag_row_cache_fill(frag_row_cache_t *rc)
+{
+    uint32_t n;
+    for (n = 1; n <= rc->rows; n++) {
+        frag_row_cache_get(rc, rc->nb, n);
+    }
+}
+
+/*
+ n: coded row, from 1
+ return: row bitmap, NULL if (nb, n) is not covered by the cache
+ */
+bm_t *frag_row_cache_get(frag_row_cache_t *rc, uint16_t nb, uint32_t n)
+{
+    bm_t *bm;
+
+    if ((rc == NULL) || (nb != rc->nb) || (n < 1) || (n > rc->rows)) {
+        return NULL;
+    }
+    bm = rc->row_bm + (n - 1) * rc->words;
+    if (!bit_get(rc->valid_bm, n - 1)) {
+        matrix_line_bm(bm, nb + n - 1, nb);
+        bit_set(rc->valid_bm, n - 1);
+    }
+    return bm;
+}
+
+static void frag_enc_xor(frag_enc_t *obj, uint8_t *des, uint8_t *src)
+{
+    FRAG_STAT(obj->stats.xor_bytes += obj->unit);
+    xor_buf(des, src, obj->unit);
+}
+
+static void frag_dec_xor(frag_dec_t *obj, uint8_t *des, uint8_t *src)
+{
+    FRAG_STAT(obj->stats.xor_bytes += obj->cfg.size);
+    xor_buf(des, src, obj->cfg.size);
+}
+
+static uint8_t *frag_enc_align(uint8_t *p)
+{
+    return p + (sizeof(bm_t) - (uintptr_t)p % sizeof(bm_t)) % sizeof(bm_t);
+}
+
+/*
+ prepare obj for frag_enc_next, no fragment is computed here
+ buf: data block, kept by the caller while fragments are produced
+ obj->dt: scratch for one matrix line, FRAG_ENC_LINE_LEN(len / unit) bytes,
+ not needed when obj->rcache holds the rows of this block
+ */
+int frag_enc_init(frag_enc_t *obj, uint8_t *buf, int len, int unit)
+{
+    int num;
+
+    if ((unit <= 0) || ((len % unit) != 0)) {
+        return -1;
+    }
+
+    num = len / unit;
+    if (num > FRAG_N_MAX) {
+        return -1;
+    }
+    if (FRAG_ENC_LINE_LEN(num) <= obj->maxlen) {
+        obj->mline = frag_enc_align(obj->dt);
+    } else if ((obj->rcache != NULL) && (obj->rcache->nb == num)) {
+        /* rows are only taken from the cache, frag_enc_next refuses the others */
+        obj->mline = NULL;
+    } else {
+        return -2;
+    }
+
+    obj->unit = unit;
+    obj->num = num;
+    obj->cr = 0;
+    obj->line = buf;
+    obj->rline = NULL;
+    FRAG_STAT(memset(&obj->stats, 0, sizeof(obj->stats)));
+    FRAG_STAT(frag_cycles_init());
+    return 0;
+}
+
+/* fragment fcnt into out, frag_enc_next without the cycle count */
+static int frag_enc_row(frag_enc_t *obj, uint32_t fcnt, uint8_t *out)
+{
+    uint32_t j;
+    bm_t *line_bm;
+
+    if ((fcnt < 1) || (fcnt > FRAG_N_MAX)) {
+        return -1;
+    }
+
+    if (fcnt <= obj->num) {
+        memcpy(out, obj->line + (fcnt - 1) * obj->unit, obj->unit);
+        return 0;
+    }
+
+    line_bm = frag_row_cache_get(obj->rcache, obj->num, fcnt - obj->num);
+    if (line_bm == NULL) {
+        if (obj->mline == NULL) {
+            return -2;
+        }
+        line_bm = (bm_t *)obj->mline;
+        matrix_line_bm(line_bm, fcnt - 1, obj->num);
+        FRAG_STAT(obj->stats.rows_gen++);
+    }
+    FRAG_STAT(obj->stats.rows++);
+
+    memset(out, 0, obj->unit);
+    for (j = 0; j < obj->num; j++) {
+        // perform a bitwise Xor operation between all the uncoded fragments corresponding to 1
+        if (bit_get(line_bm, j)) {
+            frag_enc_xor(obj, out, obj->line + j * obj->unit);
+        }
     }
     return 0;
 }
 
 /*
-unit: m
-*/
-int frag_enc(frag_enc_t *obj, uint8_t *buf, int len, int unit, int cr)
+ produce one fragment, coded ones can be requested up to FRAG_N_MAX
+ fcnt: 1 to num returns the uncoded fragments, above num the coded ones
+ out: unit bytes
+ */
+int frag_enc_next(frag_enc_t *obj, uint32_t fcnt, uint8_t *out)
+{
+#ifdef FRAG_STATS
+    uint32_t t0;
+    int ret;
+
+    t0 = frag_cycles();
+    ret = frag_enc_row(obj, fcnt, out);
+    obj->stats.cyc += (uint32_t)(frag_cycles() - t0);
+    return ret;
+#else
+    return frag_enc_row(obj, fcnt, out);
+#endif
+}
+
+/*
+ produce coded fragments fcnt to fcnt + rows - 1 into obj->rline as one
+ GF(2) product of their matrix lines and the block. The block is walked
+ BM_UNIT fragments at a time, each of them is folded into every row of the
+ tile that uses it while the tile and the chunk stay in cache.
+ obj->mline: room for rows matrix lines
+ */
+static void frag_enc_tile(frag_enc_t *obj, uint32_t fcnt, int rows)
+{
+    bm_t *row_bm[FRAG_ENC_TILE_ROWS];
+    uint8_t *out, *chunk;
+    uint32_t w, words;
+    bm_t v;
+    int r, j;
+
+    words = (obj->num + BM_UNIT - 1) / BM_UNIT;
+    for (r = 0; r < rows; r++) {
+        row_bm[r] = frag_row_cache_get(obj->rcache, obj->num, fcnt + r - obj->num);
+        if (row_bm[r] == NULL) {
+            row_bm[r] = (bm_t *)obj->mline + r * words;
+            matrix_line_bm(row_bm[r], fcnt + r - 1, obj->num);
+            FRAG_STAT(obj->stats.rows_gen++);
+        }
+    }
+    FRAG_STAT(obj->stats.rows += rows);
+
+    out = obj->rline + (fcnt - obj->num - 1) * obj->unit;
+    memset(out, 0, rows * obj->unit);
+    for (w = 0; w < words; w++) {
+        chunk = obj->line + w * BM_UNIT * obj->unit;
+        for (r = 0; r < rows; r++) {
+            v = row_bm[r][w];
+            while (v != 0) {
+                j = bit_ffs(&v, BM_UNIT);
+                v &= v - 1;
+                frag_enc_xor(obj, out + r * obj->unit, chunk + j * obj->unit);
+            }
+        }
+    }
+}
+
+/* matrix lines obj->mline has room for in obj->dt */
+static uint32_t frag_enc_mline_rows(frag_enc_t *obj)
+{
+    if (obj->mline == NULL) {
+        return 0;
+    }
+    return (obj->maxlen - (uint32_t)(obj->mline - obj->dt)) /
+           ((obj->num + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t));
+}
+
+/*
+ coded rows first to last - 1 (from 0) into obj->rline, a tile of
+ FRAG_ENC_TILE_ROWS at a time when obj->mline has room for it, otherwise
+ one by one
+ */
+int frag_enc_rows(frag_enc_t *obj, uint32_t first, uint32_t last)
+{
+    uint32_t i;
+    bool tiled;
+    int ret;
+#ifdef FRAG_STATS
+    uint32_t t0;
+#endif
+
+    FRAG_STAT(t0 = frag_cycles());
+    ret = 0;
+    tiled = (frag_enc_mline_rows(obj) >= FRAG_ENC_TILE_ROWS);
+    for (i = first; (i < last) && (ret == 0); ) {
+        if (tiled) {
+            frag_enc_tile(obj, obj->num + i + 1, (last - i < FRAG_ENC_TILE_ROWS) ? (last - i) : FRAG_ENC_TILE_ROWS);
+            i += FRAG_ENC_TILE_ROWS;
+        } else {
+            ret = frag_enc_row(obj, obj->num + i + 1, obj->rline + i * obj->unit);
+            i++;
+        }
+    }
+    FRAG_STAT(obj->stats.cyc += (uint32_t)(frag_cycles() - t0));
+    return ret;
+}
+
+/*
+ lay obj out for frag_enc: checks, block, coded rows at obj->dt + len and the
+ matrix lines after them, no fragment is computed
+ return: 1 when obj->dt also has room for FRAG_ENC_TILE_ROWS matrix lines,
+ 0 when it only holds one, < 0 as frag_enc
+ */
+int frag_enc_layout(frag_enc_t *obj, uint8_t *buf, int len, int unit, int cr)
 {
-    int i, j, k;
     int num, maxlen;
-    uint8_t *mline;
-    uint8_t *rline;
 
-    if ((len % unit) != 0) {
+    if ((unit <= 0) || ((len % unit) != 0)) {
         return -1;
     }
 
     num = len / unit;
-    printf("num is %d, unit is %d, len is %d, cr is %d\r\n", num, unit, len, cr);
-    maxlen = len + cr * unit; //+ num * cr;
+    if ((cr < 0) || (num + cr > FRAG_N_MAX)) {
+        return -1;
+    }
+    trace_put(obj->trace, TRACE_FRAG_ENC, num, unit, cr);
+    maxlen = len + cr * unit + FRAG_ENC_LINE_LEN(num);
     if (maxlen > obj->maxlen) {
-        FRAGLOG("maxlen: %d, input buffer: %d\r\n", maxlen, obj->maxlen);
+        trace_put(obj->trace, TRACE_FRAG_ENC_NOMEM, num, maxlen, obj->maxlen);
         return -2;
     }
 
     obj->unit = unit;
     obj->num = num;
     obj->cr = cr;
-    obj->line = obj->dt;
+    obj->line = buf;
     obj->rline = obj->dt + len;
-    obj->mline = obj->dt + len + cr * unit;
-
-    //memcpy(obj->dt + 0, buf, len);
-    mline = malloc(sizeof(uint8_t) * num);
-    //mline = obj->mline;
-    rline = obj->rline;
-    memset(rline, 0,cr*unit);
-
-    for (i = 0; i < cr; i++, rline += unit) {
-        // generate matrix line i+1 for matrix size num x num
-        //memset(mline, 0, num);
-        matrix_line(mline, i + 1, num);
-        for (j = 0; j < num; j++) {
-        // perform a bitwise Xor operation between all the uncoded fragments corresponding to 1
-            if (mline[j] == 1) {
-                for (k = 0; k < unit; k++) {
-                    rline[k] ^= buf[j * unit + k];
-                }
-            }
-        }
-    }
-    printf("addr of rline:: %x\n", obj->dt + len);
-    return 0;
+    obj->mline = frag_enc_align(obj->dt + len + cr * unit);
+    FRAG_STAT(memset(&obj->stats, 0, sizeof(obj->stats)));
+    FRAG_STAT(frag_cycles_init());
+    return (frag_enc_mline_rows(obj) >= FRAG_ENC_TILE_ROWS) ? 1 : 0;
 }
 
-//#define ALIGN4(x)           (x) = (((x) + 0x03) & ~0x03)
-#define ALIGN4(x)           (x) = (x)
-int frag_dec_init(frag_dec_t *obj)
+/*
+ encode the whole block at once, cr coded fragments are saved after the
+ block in obj->dt, which needs len + cr * unit + FRAG_ENC_LINE_LEN(len / unit),
+ or FRAG_ENC_TILE_LEN(len / unit) in place of the last term for the tiled
+ encoder
+unit: m
+*/
+int frag_enc(frag_enc_t *obj, uint8_t *buf, int len, int unit, int cr)
 {
-    int i, j;
+    int ret;
 
-    i = 0;
+    ret = frag_enc_layout(obj, buf, len, unit, cr);
+    if (ret < 0) {
+        return ret;
+    }
+    return frag_enc_rows(obj, 0, cr);
+}
 
-    /* TODO: check if obj->cfg.dt is aligned */
-    memset(obj->cfg.dt, 0, obj->cfg.maxlen);
+static void frag_dec_region(frag_dec_region_t *r, uint32_t *ofs, uint32_t len)
+{
+    r->ofs = *ofs;
+    r->len = FRAG_DEC_ALIGN_UP(len);
+    *ofs += r->len;
+}
 
-    ALIGN4(i);
-    obj->lost_frm_bm = (bm_t *)(obj->cfg.dt + i);
-    i += (obj->cfg.nb + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t);
+/*
+ place the buffers of a decoder for cfg->nb, cfg->size, cfg->tolerence and
+ cfg->cache_len, cfg->dt is not accessed
+ return: bytes of cfg->dt taken
+ */
+int frag_dec_layout(frag_dec_cfg_t *cfg, frag_dec_layout_t *lo)
+{
+    uint32_t i;
 
-    ALIGN4(i);
-    obj->lost_frm_matrix_bm = (bm_t *)(obj->cfg.dt + i);
+    i = 0;
+    frag_dec_region(&lo->lost_frm_bm, &i, (cfg->nb + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t));
     #ifdef FRAG_COMPRESS_MATRIX_SIZE
     /* left below of the matrix is useless compress used memory */
-    i += (obj->cfg.tolerence * (obj->cfg.tolerence + 1) / 2 + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t);
+    frag_dec_region(&lo->lost_frm_matrix_bm, &i, m2t_size(cfg->tolerence) * sizeof(bm_t));
     #else
-    i += (obj->cfg.tolerence * obj->cfg.tolerence + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t);
+    frag_dec_region(&lo->lost_frm_matrix_bm, &i,
+                    ((uint32_t)cfg->tolerence * cfg->tolerence + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t));
     #endif // FRAG_COMPRESS_MATRIX_SIZE
+    frag_dec_region(&lo->matched_lost_frm_bm0, &i, (cfg->tolerence + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t));
+    frag_dec_region(&lo->matrix_line_bm, &i, (cfg->nb + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t));
+    frag_dec_region(&lo->row_data_buf, &i, cfg->size);
+    frag_dec_region(&lo->xor_row_data_buf, &i, cfg->size);
+    frag_dec_region(&lo->cache, &i, cfg->cache_len);
+    lo->len = i;
+    return i;
+}
 
-    ALIGN4(i);
-    obj->matched_lost_frm_bm0 = (bm_t *)(obj->cfg.dt + i);
-    i += (obj->cfg.tolerence + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t);
+/* bytes of cfg->dt frag_dec_init takes for cfg->nb, cfg->size and cfg->tolerence */
+int frag_dec_mem_size(frag_dec_cfg_t *cfg)
+{
+    frag_dec_layout_t lo;
 
-    ALIGN4(i);
-    obj->matched_lost_frm_bm1 = (bm_t *)(obj->cfg.dt + i);
-    i += (obj->cfg.tolerence + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t);
+    return frag_dec_layout(cfg, &lo);
+}
 
-    ALIGN4(i);
-    obj->matrix_line_bm = (bm_t *)(obj->cfg.dt + i);
-    i += (obj->cfg.nb + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t);
+int frag_dec_init(frag_dec_t *obj)
+{
+    frag_dec_layout_t lo;
+    uint8_t *dt;
+    int i, j;
 
-    ALIGN4(i);
-    obj->row_data_buf = obj->cfg.dt + i;
-    i += obj->cfg.size;
+    /* bitmaps are accessed by bm_t words */
+    if (((uintptr_t)obj->cfg.dt % FRAG_DEC_ALIGN) != 0) {
+        return -1;
+    }
+    if ((obj->cfg.nb == 0) || (obj->cfg.nb > FRAG_N_MAX)) {
+        return -1;
+    }
+    i = frag_dec_layout(&obj->cfg, &lo);
+    if ((uint32_t)i > obj->cfg.maxlen) {
+        return -1;
+    }
 
-    ALIGN4(i);
-    obj->xor_row_data_buf = obj->cfg.dt + i;
-    i += obj->cfg.size;
+    dt = obj->cfg.dt;
+    obj->lost_frm_bm = (bm_t *)(dt + lo.lost_frm_bm.ofs);
+    obj->lost_frm_matrix_bm = (bm_t *)(dt + lo.lost_frm_matrix_bm.ofs);
+    obj->matched_lost_frm_bm0 = (bm_t *)(dt + lo.matched_lost_frm_bm0.ofs);
+    obj->matrix_line_bm = (bm_t *)(dt + lo.matrix_line_bm.ofs);
+    obj->row_data_buf = dt + lo.row_data_buf.ofs;
+    obj->xor_row_data_buf = dt + lo.xor_row_data_buf.ofs;
 
-    ALIGN4(i);
-    if (i > obj->cfg.maxlen) {
-        return -1;
+    /* fragment cache: lookup table, then per slot its index, data and dirty flag */
+    obj->cache_slots = 0;
+    obj->cache_used = 0;
+    obj->cache_victim = 0;
+    obj->cache_hit = 0;
+    obj->cache_miss = 0;
+    if (obj->cfg.cache_len > 0) {
+        /* the table takes at most 4 entries per slot */
+        j = obj->cfg.cache_len / (obj->cfg.size + sizeof(uint16_t) + 1 + 4 * sizeof(uint16_t));
+        obj->cache_slots = (j < obj->cfg.nb) ? j : obj->cfg.nb;
+        for (j = 2; j < 2 * obj->cache_slots; j <<= 1);
+        obj->cache_mask = j - 1;
+        obj->cache_table = (uint16_t *)(dt + lo.cache.ofs);
+        obj->cache_index = obj->cache_table + j;
+        obj->cache_data = (uint8_t *)(obj->cache_index + obj->cache_slots);
+        obj->cache_dirty = obj->cache_data + obj->cache_slots * obj->cfg.size;
+    }
+
+    /* what the caller gave beyond the layout holds the reconstruction window */
+    j = (obj->cfg.maxlen - i) / FRAG_DEC_ROW_LEN(obj->cfg.size);
+    if (j > 0) {
+        obj->recon_buf = dt + i;
+        obj->recon_slots = (j < obj->cfg.tolerence) ? j : obj->cfg.tolerence;
+    } else {
+        obj->recon_buf = obj->xor_row_data_buf;
+        obj->recon_slots = 1;
+    }
+
+    /*
+     only what is read before frag_dec writes it is set: the lost frame
+     matrix, the cache table and lost_frm_bm, the other regions are cleared
+     or filled on use
+     */
+    memset(obj->lost_frm_matrix_bm, 0, lo.lost_frm_matrix_bm.len);
+    if (obj->cache_slots > 0) {
+        memset(obj->cache_table, 0xFF, (obj->cache_mask + 1) * sizeof(uint16_t));
     }
 
-    /* set all frame lost, from 0 to nb-1 */
+    /* set all frame lost, from 0 to nb-1, the bits past nb stay clear */
     obj->lost_frm_count = obj->cfg.nb;
-    for (j = 0; j < obj->cfg.nb; j++) {
-        bit_set(obj->lost_frm_bm, j);
+    memset(obj->lost_frm_bm, 0xFF, obj->cfg.nb / BM_UNIT * sizeof(bm_t));
+    if ((obj->cfg.nb % BM_UNIT) != 0) {
+        obj->lost_frm_bm[obj->cfg.nb / BM_UNIT] = ((bm_t)1 << (obj->cfg.nb % BM_UNIT)) - 1;
     }
 
     obj->filled_lost_frm_count = 0;
+    obj->useful_frm_count = 0;
+    obj->redundant_frm_count = 0;
     obj->sta = FRAG_DEC_STA_UNCODED;
+    FRAG_STAT(memset(&obj->stats, 0, sizeof(obj->stats)));
+    FRAG_STAT(frag_cycles_init());
 
     return i;
 }
@@ -221,18 +544,156 @@ void frag_dec_frame_received(frag_dec_t *obj, uint16_t index)
     }
 }
 
+/*
+ Fragment cache. Two kinds of fragments go through the flash callbacks:
+ received uncoded ones, each read back by about half of the coded frames,
+ and the rows of lost fragments, which are read by every elimination that
+ reaches them and rewritten by the final back substitution. The rows of
+ lost fragments are few and read the most, they are kept dirty in the
+ cache and take the slot of an uncoded fragment when no slot is free.
+ Uncoded fragments only take free slots: they are read in a sweep, so
+ replacing one by another would make every read of the sweep a miss.
+ */
+static int frag_dec_cache_find(frag_dec_t *obj, uint16_t index)
+{
+    uint32_t h;
+    uint16_t slot;
+
+    if (obj->cache_slots == 0) {
+        return -1;
+    }
+    for (h = index & obj->cache_mask; ; h = (h + 1) & obj->cache_mask) {
+        slot = obj->cache_table[h];
+        if (slot == 0xFFFF) {
+            return -1;
+        }
+        if (obj->cache_index[slot] == index) {
+            return slot;
+        }
+    }
+}
+
+static void frag_dec_cache_insert(frag_dec_t *obj, uint16_t index, uint16_t slot)
+{
+    uint32_t h;
+
+    for (h = index & obj->cache_mask; obj->cache_table[h] != 0xFFFF; h = (h + 1) & obj->cache_mask);
+    obj->cache_table[h] = slot;
+    obj->cache_index[slot] = index;
+}
+
+static void frag_dec_cache_remove(frag_dec_t *obj, uint16_t index)
+{
+    uint32_t h, k, home;
+
+    for (h = index & obj->cache_mask; obj->cache_index[obj->cache_table[h]] != index; h = (h + 1) & obj->cache_mask);
+    /* backward shift the entries after h so that no probe sequence is broken */
+    k = h;
+    while (1) {
+        k = (k + 1) & obj->cache_mask;
+        if (obj->cache_table[k] == 0xFFFF) {
+            break;
+        }
+        home = obj->cache_index[obj->cache_table[k]] & obj->cache_mask;
+        if (((k - home) & obj->cache_mask) >= ((k - h) & obj->cache_mask)) {
+            obj->cache_table[h] = obj->cache_table[k];
+            h = k;
+        }
+    }
+    obj->cache_table[h] = 0xFFFF;
+}
+
+/*
+ take a slot for fragment index, -1 if it should stay in flash only.
+ lost_frm_bm doesn't change once coded frames come in, so a slot taken by
+ a lost row is never given back and the victim search only moves forward.
+ */
+static int frag_dec_cache_alloc(frag_dec_t *obj, uint16_t index)
+{
+    uint16_t slot;
+
+    if (obj->cache_used < obj->cache_slots) {
+        slot = obj->cache_used++;
+    } else {
+        if (!bit_get(obj->lost_frm_bm, index)) {
+            return -1;
+        }
+        while ((obj->cache_victim < obj->cache_slots) &&
+               bit_get(obj->lost_frm_bm, obj->cache_index[obj->cache_victim])) {
+            obj->cache_victim++;
+        }
+        if (obj->cache_victim == obj->cache_slots) {
+            return -1;
+        }
+        slot = obj->cache_victim++;
+        /* uncoded fragments are written through, nothing to flush */
+        frag_dec_cache_remove(obj, obj->cache_index[slot]);
+    }
+    frag_dec_cache_insert(obj, index, slot);
+    obj->cache_dirty[slot] = 0;
+    return slot;
+}
+
+/* write all dirty rows to flash, once the block is reconstructed */
+static void frag_dec_cache_flush(frag_dec_t *obj)
+{
+    int i;
+
+    for (i = 0; i < obj->cache_used; i++) {
+        if (obj->cache_dirty[i]) {
+            FRAG_STAT(obj->stats.fwr_calls++);
+            FRAG_STAT(obj->stats.fwr_bytes += obj->cfg.size);
+            obj->cfg.fwr_func(obj->cfg.faddr + obj->cache_index[i] * obj->cfg.size,
+                              obj->cache_data + i * obj->cfg.size, obj->cfg.size);
+            obj->cache_dirty[i] = 0;
+        }
+    }
+}
+
 void frag_dec_flash_wr(frag_dec_t *obj, uint16_t index, uint8_t *buf)
 {
-    obj->cfg.fwr_func(index * obj->cfg.size, buf, obj->cfg.size);
+    int slot;
+
     #ifdef DEBUG
     FRAGDBG("-> index %d, ", index);
     frag_dec_log_buf(buf, obj->cfg.size);
     #endif
+
+    slot = frag_dec_cache_find(obj, index);
+    if (slot < 0) {
+        slot = frag_dec_cache_alloc(obj, index);
+    }
+    if (slot >= 0) {
+        memcpy(obj->cache_data + slot * obj->cfg.size, buf, obj->cfg.size);
+        if (bit_get(obj->lost_frm_bm, index)) {
+            /* row of a lost fragment, written back by frag_dec_cache_flush */
+            obj->cache_dirty[slot] = 1;
+            return;
+        }
+    }
+    FRAG_STAT(obj->stats.fwr_calls++);
+    FRAG_STAT(obj->stats.fwr_bytes += obj->cfg.size);
+    obj->cfg.fwr_func(obj->cfg.faddr + index * obj->cfg.size, buf, obj->cfg.size);
 }
 
 void frag_dec_flash_rd(frag_dec_t *obj, uint16_t index, uint8_t *buf)
 {
-    obj->cfg.frd_func(index * obj->cfg.size, buf, obj->cfg.size);
+    int slot;
+
+    slot = frag_dec_cache_find(obj, index);
+    if (slot >= 0) {
+        obj->cache_hit++;
+        memcpy(buf, obj->cache_data + slot * obj->cfg.size, obj->cfg.size);
+    } else {
+        obj->cache_miss++;
+        FRAG_STAT(obj->stats.frd_calls++);
+        FRAG_STAT(obj->stats.frd_bytes += obj->cfg.size);
+        obj->cfg.frd_func(obj->cfg.faddr + index * obj->cfg.size, buf, obj->cfg.size);
+        slot = frag_dec_cache_alloc(obj, index);
+        if (slot >= 0) {
+            memcpy(obj->cache_data + slot * obj->cfg.size, buf, obj->cfg.size);
+        }
+    }
     #ifdef DEBUG
     FRAGDBG("<- index %d, ", index);
     frag_dec_log_buf(buf, obj->cfg.size);
@@ -240,27 +701,31 @@ void frag_dec_flash_rd(frag_dec_t *obj, uint16_t index, uint8_t *buf)
 }
 
 #ifdef FRAG_COMPRESS_MATRIX_SIZE
+/* rows are word runs starting at word lindex >> BM_OFST, bits of map below lindex are clear */
 void frag_dec_lost_frm_matrix_save(frag_dec_t *obj, uint16_t lindex, bm_t *map, int len)
 {
-    int i;
-    for (i = 0; i < len; i++) {
-        if (bit_get(map, i)) {
-            m2t_set(obj->lost_frm_matrix_bm, i, lindex, len);
-        } else {
-            m2t_clr(obj->lost_frm_matrix_bm, i, lindex, len);
-        }
+    int w, nw;
+    bm_t *row;
+
+    row = m2t_row(obj->lost_frm_matrix_bm, lindex, len);
+    nw = (len + BM_UNIT - 1) >> BM_OFST;
+    for (w = lindex >> BM_OFST; w < nw; w++) {
+        row[w] = map[w];
     }
 }
 
-void frag_dec_lost_frm_matrix_load(frag_dec_t *obj, uint16_t lindex, bm_t *map, int len)
+/* map ^= row lindex */
+void frag_dec_lost_frm_matrix_xor(frag_dec_t *obj, uint16_t lindex, bm_t *map, int len)
 {
-    int i;
-    for (i = 0; i < len; i++) {
-        if (m2t_get(obj->lost_frm_matrix_bm, i, lindex, len)) {
-            bit_set(map, i);
-        } else {
-            bit_clr(map, i);
-        }
+    int w, w0, nw;
+    bm_t *row;
+
+    row = m2t_row(obj->lost_frm_matrix_bm, lindex, len);
+    w0 = lindex >> BM_OFST;
+    nw = (len + BM_UNIT - 1) >> BM_OFST;
+    map[w0] ^= row[w0] & ~(((bm_t)1 << (lindex & (BM_UNIT - 1))) - 1);
+    for (w = w0 + 1; w < nw; w++) {
+        map[w] ^= row[w];
     }
 }
 
@@ -268,6 +733,12 @@ bool frag_dec_lost_frm_matrix_is_diagonal(frag_dec_t *obj, uint16_t lindex, int
 {
     return m2t_get(obj->lost_frm_matrix_bm, lindex, lindex, len);
 }
+
+/* bit i of row lindex */
+bool frag_dec_lost_frm_matrix_get(frag_dec_t *obj, uint16_t lindex, int i, int len)
+{
+    return m2t_get(obj->lost_frm_matrix_bm, i, lindex, len);
+}
 #else
 void frag_dec_lost_frm_matrix_save(frag_dec_t *obj, uint16_t lindex, bm_t *map, int len)
 {
@@ -283,46 +754,116 @@ void frag_dec_lost_frm_matrix_save(frag_dec_t *obj, uint16_t lindex, bm_t *map,
     }
 }
 
-void frag_dec_lost_frm_matrix_load(frag_dec_t *obj, uint16_t lindex, bm_t *map, int len)
+bool frag_dec_lost_frm_matrix_is_diagonal(frag_dec_t *obj, uint16_t lindex, int len)
 {
-    int i, offset;
-    offset = lindex * len;
+    return bit_get(obj->lost_frm_matrix_bm, lindex * len + lindex);
+}
+
+bool frag_dec_lost_frm_matrix_get(frag_dec_t *obj, uint16_t lindex, int i, int len)
+{
+    return bit_get(obj->lost_frm_matrix_bm, lindex * len + i);
+}
+
+void frag_dec_lost_frm_matrix_xor(frag_dec_t *obj, uint16_t lindex, bm_t *map, int len)
+{
+    int i;
     for (i = 0; i < len; i++) {
-        if (bit_get(obj->lost_frm_matrix_bm, offset + i)) {
-            bit_set(map, i);
-        } else {
-            bit_clr(map, i);
+        if (bit_get(obj->lost_frm_matrix_bm, lindex * len + i)) {
+            bit_get(map, i) ? bit_clr(map, i) : bit_set(map, i);
         }
     }
 }
+#endif
 
-bool frag_dec_lost_frm_matrix_is_diagonal(frag_dec_t *obj, uint16_t lindex, int len)
+/*
+ Back substitution. Row i of the lost frame matrix is upper triangular, so
+ once the rows below it are final its data only has to be xored with the
+ final data of every row j > i whose bit is set. Rows are taken from the
+ bottom in windows of recon_slots rows held in RAM: the window is read,
+ every final row below it is read once and folded into all window rows
+ that use it, the window is solved bottom up in RAM and written back.
+ With a window of lost_frm_count rows, each lost fragment is read and
+ written once. The matrix is only read, it is not reduced to the identity.
+ */
+static void frag_dec_reconstruct(frag_dec_t *obj)
 {
-    return bit_get(obj->lost_frm_matrix_bm, lindex * len + lindex);
+    int lo, hi, i, j, len, size, stride;
+    bool used;
+    uint8_t *win;
+
+    len = obj->lost_frm_count;
+    size = obj->cfg.size;
+    stride = FRAG_DEC_ROW_LEN(size);
+    win = obj->recon_buf;
+    for (hi = len; hi > 0; hi = lo) {
+        lo = (hi > obj->recon_slots) ? (hi - obj->recon_slots) : 0;
+        for (i = lo; i < hi; i++) {
+            frag_dec_flash_rd(obj, bit_fns(obj->lost_frm_bm, obj->cfg.nb, i + 1), win + (i - lo) * stride);
+        }
+
+        /* final rows below the window */
+        for (j = hi; j < len; j++) {
+            used = false;
+            for (i = lo; i < hi; i++) {
+                if (frag_dec_lost_frm_matrix_get(obj, i, j, len)) {
+                    if (!used) {
+                        frag_dec_flash_rd(obj, bit_fns(obj->lost_frm_bm, obj->cfg.nb, j + 1), obj->row_data_buf);
+                        used = true;
+                    }
+                    frag_dec_xor(obj, win + (i - lo) * stride, obj->row_data_buf);
+                }
+            }
+        }
+
+        /* rows inside the window, bottom up */
+        for (i = hi - 2; i >= lo; i--) {
+            for (j = i + 1; j < hi; j++) {
+                if (frag_dec_lost_frm_matrix_get(obj, i, j, len)) {
+                    frag_dec_xor(obj, win + (i - lo) * stride, win + (j - lo) * stride);
+                }
+            }
+        }
+
+        for (i = lo; i < hi; i++) {
+            for (j = i + 1; j < len; j++) {
+                if (frag_dec_lost_frm_matrix_get(obj, i, j, len)) {
+                    break;
+                }
+            }
+            if (j < len) {
+                /* rows without bits right of the diagonal are final already */
+                frag_dec_flash_wr(obj, bit_fns(obj->lost_frm_bm, obj->cfg.nb, i + 1), win + (i - lo) * stride);
+            }
+        }
+    }
 }
-#endif
 
-/* fcnt from 1 to nb */
-int frag_dec(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len)
+/* frag_dec without the stage cycle counts */
+static int frag_dec_frame(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len)
 {
-    int i, j;
+    int i;
     int index, unmatched_frame_cnt;
-    int lost_frame_index, frame_index, frame_index1;
+    int lost_frame_index, frame_index;
     bool no_info;
+    bm_t *line_bm;
+#ifdef FRAG_STATS
+    uint32_t steps, t0;
+#endif
 
     if (obj->sta == FRAG_DEC_STA_DONE) {
         //////////debug("line 311, returning %d\r\n", obj->lost_frm_count);
+        obj->redundant_frm_count++;
+        FRAG_STAT(obj->stats.redundant++);
         return obj->lost_frm_count;
     }
 
-    if (len != obj->cfg.size) {
+    if ((len != obj->cfg.size) || (fcnt == 0) || (fcnt > FRAG_N_MAX)) {
         ////debug("line 316, invalid frame\r\n");
         return FRAG_DEC_ERR_INVALID_FRAME;
     }
 
     /* clear all temporary bm and buf */
     bit_clear_all(obj->matched_lost_frm_bm0, obj->lost_frm_count);
-    bit_clear_all(obj->matched_lost_frm_bm1, obj->lost_frm_count);
 
     /* back up input data so that not to mess input data */
     memcpy(obj->xor_row_data_buf, buf, obj->cfg.size);
@@ -330,6 +871,13 @@ int frag_dec(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len)
     index = fcnt - 1;
     if ((index < obj->cfg.nb) && (obj->sta == FRAG_DEC_STA_UNCODED)) {
         /* uncoded frames under uncoded process */
+        if (!bit_get(obj->lost_frm_bm, index)) {
+            /* repeated frame, its data is stored already */
+            obj->redundant_frm_count++;
+            FRAG_STAT(obj->stats.redundant++);
+            return FRAG_DEC_ONGOING;
+        }
+        obj->useful_frm_count++;
         /* mark new received frame */
         frag_dec_frame_received(obj, index);
         /* save data to flash */
@@ -337,6 +885,7 @@ int frag_dec(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len)
         /* if no frame lost finish decode process */
         if (obj->lost_frm_count == 0) {
             obj->sta = FRAG_DEC_STA_DONE;
+            trace_put(obj->cfg.trace, TRACE_FRAG_DEC_DONE, 0, obj->useful_frm_count, obj->redundant_frm_count);
             //////debug("line 337 returning %d\r\n", obj->lost_frm_count);
             return obj->lost_frm_count;
         }
@@ -347,16 +896,24 @@ int frag_dec(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len)
         if (obj->lost_frm_count > obj->cfg.tolerence) {
             /* too many frames are lost, memory is not enough to reconstruct the packets */
             //////debug("line 346, too many frames lost \r\n");
+            trace_put(obj->cfg.trace, TRACE_FRAG_DEC_LOST, obj->lost_frm_count, obj->cfg.tolerence, fcnt);
             return FRAG_DEC_ERR_TOO_MANY_FRAME_LOST;
         }
         unmatched_frame_cnt = 0;
-        matrix_line_bm(obj->matrix_line_bm, index, obj->cfg.nb);
+        line_bm = NULL;
+        if (index >= obj->cfg.nb) {
+            line_bm = frag_row_cache_get(obj->cfg.rcache, obj->cfg.nb, index - obj->cfg.nb + 1);
+        }
+        if (line_bm == NULL) {
+            line_bm = obj->matrix_line_bm;
+            matrix_line_bm(line_bm, index, obj->cfg.nb);
+        }
         for (i = 0; i < obj->cfg.nb; i++) {
-            if (bit_get(obj->matrix_line_bm, i) == true) {
+            if (bit_get(line_bm, i) == true) {
                 if (bit_get(obj->lost_frm_bm, i) == false) {
                     /* coded frame is matched one received uncoded frame */
                     frag_dec_flash_rd(obj, i, obj->row_data_buf);
-                    buf_xor(obj->xor_row_data_buf, obj->row_data_buf, obj->cfg.size);
+                    frag_dec_xor(obj, obj->xor_row_data_buf, obj->row_data_buf);
                 } else {
                     /* coded frame is not matched one received uncoded frame */
                     /* matched_lost_frm_bm0 index is the nth lost frame */
@@ -367,27 +924,29 @@ int frag_dec(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len)
         }
         if (unmatched_frame_cnt <= 0) {
             //////debug("line 366, ongoing\r\n");
+            obj->redundant_frm_count++;
+            FRAG_STAT(obj->stats.redundant++);
             return FRAG_DEC_ONGOING;
         }
 
 #ifdef DEBUG
         FRAGDBG("matrix_line_bm: %d, ", index);
-        frag_dec_log_bits(obj->matrix_line_bm, obj->cfg.nb);
+        frag_dec_log_bits(line_bm, obj->cfg.nb);
         FRAGDBG("matched_lost_frm_bm0: ");
         frag_dec_log_bits(obj->matched_lost_frm_bm0, obj->lost_frm_count);
 #endif
         /* obj->matched_lost_frm_bm0 now saves new coded frame which excludes all received frames content */
         /* start to diagonal obj->matched_lost_frm_bm0 */
+        FRAG_STAT(obj->stats.coded_frames++);
+        FRAG_STAT(steps = 0);
         no_info = false;
         do {
             lost_frame_index = bit_ffs(obj->matched_lost_frm_bm0, obj->lost_frm_count);
             frame_index = bit_fns(obj->lost_frm_bm, obj->cfg.nb, lost_frame_index + 1);
             if (frame_index == -1) {
-                FRAGLOG("matched_lost_frm_bm0: ");
-                frag_dec_log_bits(obj->matched_lost_frm_bm0, obj->lost_frm_count);
-                FRAGLOG("lost_frm_bm: ");
-                frag_dec_log_bits(obj->lost_frm_bm, obj->cfg.nb);
-                FRAGLOG("frame_index: %d, lost_frame_index: %d\n", frame_index, lost_frame_index);
+                /* lost frame bitmaps are inconsistent, the session can't be decoded */
+                trace_put(obj->cfg.trace, TRACE_FRAG_DEC_ERR_1, fcnt, lost_frame_index, obj->lost_frm_count);
+                return FRAG_DEC_ERR_1;
             }
 #ifdef DEBUG
             FRAGDBG("matched_lost_frm_bm0: ");
@@ -400,42 +959,42 @@ int frag_dec(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len)
                 break;
             }
 
-            frag_dec_lost_frm_matrix_load(obj, lost_frame_index, obj->matched_lost_frm_bm1, obj->lost_frm_count);
-            bit_xor(obj->matched_lost_frm_bm0, obj->matched_lost_frm_bm1, obj->lost_frm_count);
+            frag_dec_lost_frm_matrix_xor(obj, lost_frame_index, obj->matched_lost_frm_bm0, obj->lost_frm_count);
+            FRAG_STAT(obj->stats.row_loads++);
+            FRAG_STAT(steps++);
             frag_dec_flash_rd(obj, frame_index, obj->row_data_buf);
-            buf_xor(obj->xor_row_data_buf, obj->row_data_buf, obj->cfg.size);
+            frag_dec_xor(obj, obj->xor_row_data_buf, obj->row_data_buf);
             if (bit_is_all_clear(obj->matched_lost_frm_bm0, obj->lost_frm_count)) {
                 no_info = true;
                 break;
             }
         } while (1);
+#ifdef FRAG_STATS
+        obj->stats.elim_steps += steps;
+        if (steps > obj->stats.elim_max) {
+            obj->stats.elim_max = steps;
+        }
+#endif
         if (!no_info) {
             /* current frame contains new information, save it */
             frag_dec_lost_frm_matrix_save(obj, lost_frame_index, obj->matched_lost_frm_bm0, obj->lost_frm_count);
+            FRAG_STAT(obj->stats.row_saves++);
             frag_dec_flash_wr(obj, frame_index, obj->xor_row_data_buf);
             obj->filled_lost_frm_count++;
+            obj->useful_frm_count++;
+        } else {
+            obj->redundant_frm_count++;
+            FRAG_STAT(obj->stats.redundant++);
         }
         if (obj->filled_lost_frm_count == obj->lost_frm_count) {
             /* all frame content is received, now to reconstruct the whole frame */
-            if (obj->lost_frm_count > 1) {
-                for (i = (obj->lost_frm_count - 2); i >= 0; i--) {
-                    frame_index = bit_fns(obj->lost_frm_bm, obj->cfg.nb, i + 1);
-                    frag_dec_flash_rd(obj, frame_index, obj->xor_row_data_buf);
-                    for (j = (obj->lost_frm_count  - 1); j > i; j--) {
-                        frag_dec_lost_frm_matrix_load(obj, i, obj->matched_lost_frm_bm1, obj->lost_frm_count);
-                        frag_dec_lost_frm_matrix_load(obj, j, obj->matched_lost_frm_bm0, obj->lost_frm_count);
-                        if (bit_get(obj->matched_lost_frm_bm1, j)) {
-                            frame_index1 = bit_fns(obj->lost_frm_bm, obj->cfg.nb, j + 1);
-                            frag_dec_flash_rd(obj, frame_index1, obj->row_data_buf);
-                            bit_xor(obj->matched_lost_frm_bm1, obj->matched_lost_frm_bm0, obj->lost_frm_count);
-                            buf_xor(obj->xor_row_data_buf, obj->row_data_buf, obj->cfg.size);
-                            frag_dec_lost_frm_matrix_save(obj, i, obj->matched_lost_frm_bm1, obj->lost_frm_count);
-                        }
-                    }
-                    frag_dec_flash_wr(obj, frame_index, obj->xor_row_data_buf);
-                }
-            }
+            FRAG_STAT(t0 = frag_cycles());
+            frag_dec_reconstruct(obj);
+            frag_dec_cache_flush(obj);
+            FRAG_STAT(obj->stats.cyc_recon += (uint32_t)(frag_cycles() - t0));
             obj->sta = FRAG_DEC_STA_DONE;
+            trace_put(obj->cfg.trace, TRACE_FRAG_DEC_DONE, obj->lost_frm_count, obj->useful_frm_count,
+                      obj->redundant_frm_count);
             //////debug("line 436, returning %d\r\n", obj->lost_frm_count);
             return obj->lost_frm_count;
         }
@@ -445,6 +1004,64 @@ int frag_dec(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len)
     return FRAG_DEC_ONGOING;
 }
 
+/* fcnt from 1 to nb */
+int frag_dec(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len)
+{
+#ifdef FRAG_STATS
+    uint32_t t0, t;
+    uint64_t recon;
+    bool uncoded;
+    int ret;
+
+    /* the frame goes to the stage frag_dec_frame picks for it, less the back substitution */
+    uncoded = (fcnt >= 1) && (fcnt <= obj->cfg.nb) && (obj->sta == FRAG_DEC_STA_UNCODED);
+    recon = obj->stats.cyc_recon;
+    t0 = frag_cycles();
+    ret = frag_dec_frame(obj, fcnt, buf, len);
+    t = (uint32_t)(frag_cycles() - t0) - (uint32_t)(obj->stats.cyc_recon - recon);
+    if (uncoded) {
+        obj->stats.cyc_uncoded += t;
+    } else {
+        obj->stats.cyc_coded += t;
+    }
+    return ret;
+#else
+    return frag_dec_frame(obj, fcnt, buf, len);
+#endif
+}
+
+/* independent fragments known so far, nb once the block can be rebuilt */
+int frag_dec_rank(frag_dec_t *obj)
+{
+    return obj->cfg.nb - obj->lost_frm_count + obj->filled_lost_frm_count;
+}
+
+/*
+ For a deficit of d, random parity rows need on average
+ sum(1 / (1 - 2^-i), i = 1..d) more frames, about d + 1.6, this is
+ rounded up. The estimate counts received frames: the sender has to send
+ needed / (1 - loss rate).
+ */
+void frag_dec_status(frag_dec_t *obj, frag_dec_status_t *st)
+{
+    int d;
+
+    st->nb = obj->cfg.nb;
+    st->rank = frag_dec_rank(obj);
+    st->useful = obj->useful_frm_count;
+    st->redundant = obj->redundant_frm_count;
+    d = st->nb - st->rank;
+    if ((obj->sta == FRAG_DEC_STA_CODED) && (obj->lost_frm_count > obj->cfg.tolerence)) {
+        st->needed = FRAG_DEC_NEEDED_NEVER;
+    } else if (d <= 0) {
+        st->needed = 0;
+    } else if (d == 1) {
+        st->needed = 2;
+    } else {
+        st->needed = d + 2;
+    }
+}
+
 void frag_dec_log_buf(uint8_t *buf, int len)
 {
     int i;
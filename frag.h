@@ -1,12 +1,14 @@
 #ifndef __FRAGMENTATION_H
 #define __FRAGMENTATION_H
 
-#include <cstdio>
-#include <cstring>
-#include <cstdlib>
-#include <cstdint>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "bitmap.h"
+#include "xorbuf.h"
+#include "trace.h"
 
 /*
 https://github.com/brocaar/lorawan/blob/master/applayer/fragmentation/encode.go
@@ -20,18 +22,88 @@ https://github.com/brocaar/lorawan/blob/master/applayer/fragmentation/encode_tes
 #define FRAG_DEC_ERR_1                      (-4)
 #define FRAG_DEC_ERR_2                      (-5)
 
+/* fragment numbers are 14 bits on air (N of the LoRaWAN DataFragment), nb + cr at most */
+#define FRAG_N_MAX                          (0x3FFF)
+
+/*
+ cache of generated parity matrix rows for one nb, coded row n (from 1) is
+ stored as a bitmap of nb bits. Rows are generated on first use, or all at
+ once with frag_row_cache_fill, after which the cache is only read and can
+ be shared by any number of encoders and decoders.
+ */
+typedef struct {
+    uint16_t nb;
+    uint16_t rows;
+    uint16_t words;             // bm_t words per row
+    bm_t *valid_bm;
+    bm_t *row_bm;
+} frag_row_cache_t;
+
+/* bytes frag_row_cache_init takes for rows coded rows of nb fragments */
+#define FRAG_ROW_CACHE_LEN(nb, rows)    (((rows) + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t) + \
+                                         (uint32_t)(rows) * (((nb) + BM_UNIT - 1) / BM_UNIT) * sizeof(bm_t))
+
+/*
+ Performance counters, kept when built with -DFRAG_STATS and cleared by
+ frag_enc_init, frag_enc_layout (so frag_enc) and frag_dec_init. Cycles
+ come from the DWT cycle counter on Cortex-M3 and up, from CLOCK_MONOTONIC
+ (ns) on Linux, or from FRAG_STATS_CLOCK() when it is defined, e.g.
+ us_ticker_read on Cortex-M0.
+ */
+typedef struct {
+    uint64_t xor_bytes;
+    uint32_t rows;              // coded fragments computed
+    uint32_t rows_gen;          // of which the parity row was generated, not read from the row cache
+    uint64_t cyc;
+} frag_enc_stats_t;
+
+typedef struct {
+    uint64_t xor_bytes;
+    uint32_t frd_calls;
+    uint64_t frd_bytes;
+    uint32_t fwr_calls;
+    uint64_t fwr_bytes;
+    uint32_t row_loads;         // lost fragment matrix rows read by the elimination
+    uint32_t row_saves;
+    uint32_t coded_frames;      // frames that went through the elimination
+    uint32_t elim_steps;        // rows eliminated, all coded frames together
+    uint32_t elim_max;          // most rows eliminated for one frame
+    uint32_t redundant;         // as redundant_frm_count
+    uint64_t cyc_uncoded;       // uncoded frames ingested before the first coded one
+    uint64_t cyc_coded;         // elimination of coded frames
+    uint64_t cyc_recon;         // back substitution and cache flush
+} frag_dec_stats_t;
+
 typedef struct {
     uint8_t *dt;
     uint32_t maxlen;
+    frag_row_cache_t *rcache;   // optional, NULL when not used
+    trace_t *trace;             // optional, NULL when not used
 
     uint32_t unit;
     uint32_t num;
     uint32_t cr;
-    uint8_t *line;
-    uint8_t *mline;
-    uint8_t *rline;
+    uint8_t *line;              // uncoded fragments
+    uint8_t *mline;             // matrix line bitmap scratch
+    uint8_t *rline;             // coded fragments, frag_enc only
+#ifdef FRAG_STATS
+    frag_enc_stats_t stats;
+#endif
 } frag_enc_t;
 
+/* bytes of obj->dt taken by the matrix line of num fragments, alignment included */
+#define FRAG_ENC_LINE_LEN(num)  (((num) + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t) + sizeof(bm_t) - 1)
+
+/*
+ coded rows frag_enc computes per pass when obj->dt also holds
+ FRAG_ENC_TILE_LEN(num) bytes of matrix lines, the block is then streamed
+ once per FRAG_ENC_TILE_ROWS coded rows instead of once per row
+ */
+#ifndef FRAG_ENC_TILE_ROWS
+#define FRAG_ENC_TILE_ROWS      (64)
+#endif
+#define FRAG_ENC_TILE_LEN(num)  (FRAG_ENC_TILE_ROWS * (((num) + BM_UNIT - 1) / BM_UNIT) * sizeof(bm_t) + sizeof(bm_t) - 1)
+
 typedef int (*flash_rd_t)(uint32_t addr, uint8_t *buf, uint32_t len);
 typedef int (*flash_wr_t)(uint32_t addr, uint8_t *buf, uint32_t len);
 
@@ -41,10 +113,44 @@ typedef struct {
     uint16_t nb;
     uint8_t size;
     uint16_t tolerence;
+    uint32_t faddr;             // flash address of fragment 0
     flash_rd_t frd_func;
     flash_wr_t fwr_func;
+    frag_row_cache_t *rcache;   // optional, NULL when not used
+    trace_t *trace;             // optional, NULL when not used
+    uint32_t cache_len;         // bytes of dt for the fragment cache, 0: no cache
 } frag_dec_cfg_t;
 
+/*
+ regions of cfg.dt start on FRAG_DEC_ALIGN bytes, a power of two of at
+ least sizeof(bm_t), and cfg.dt must be aligned the same way. The default
+ keeps the bitmaps and fragment rows word aligned, 32 or 64 puts every
+ region on its own cache lines.
+ */
+#ifndef FRAG_DEC_ALIGN
+#define FRAG_DEC_ALIGN          (sizeof(bm_t))
+#endif
+#define FRAG_DEC_ALIGN_UP(x)    (((x) + FRAG_DEC_ALIGN - 1) / FRAG_DEC_ALIGN * FRAG_DEC_ALIGN)
+/* bytes of cfg.dt a fragment row takes, rows of the reconstruction window included */
+#define FRAG_DEC_ROW_LEN(size)  FRAG_DEC_ALIGN_UP((uint32_t)(size))
+
+typedef struct {
+    uint32_t ofs;               // from cfg.dt
+    uint32_t len;               // aligned
+} frag_dec_region_t;
+
+/* placement of the frag_dec_t buffers in cfg.dt, from frag_dec_layout */
+typedef struct {
+    frag_dec_region_t lost_frm_bm;
+    frag_dec_region_t lost_frm_matrix_bm;
+    frag_dec_region_t matched_lost_frm_bm0;
+    frag_dec_region_t matrix_line_bm;
+    frag_dec_region_t row_data_buf;
+    frag_dec_region_t xor_row_data_buf;
+    frag_dec_region_t cache;
+    uint32_t len;               // end of the layout, the reconstruction window follows
+} frag_dec_layout_t;
+
 typedef enum {
     FRAG_DEC_STA_UNCODED,       // wait uncoded fragmentations
     FRAG_DEC_STA_CODED,         // wait coded fragmentations, uncoded frags are processed as coded ones
@@ -61,24 +167,64 @@ typedef struct {
     uint16_t lost_frm_count;
     bm_t *lost_frm_matrix_bm;
     uint16_t filled_lost_frm_count;
+    uint16_t useful_frm_count;      // frames that raised the rank
+    uint16_t redundant_frm_count;   // repeated, fully known or linearly dependent frames
 
     /* temporary buffer */
     bm_t *matched_lost_frm_bm0;
-    bm_t *matched_lost_frm_bm1;
     bm_t *matrix_line_bm;
     uint8_t *row_data_buf;
     uint8_t *xor_row_data_buf;
+
+    /* fragment cache in front of frd_func / fwr_func */
+    uint16_t cache_slots;
+    uint16_t cache_used;        // slots 0 to cache_used - 1 hold a fragment
+    uint16_t cache_victim;      // next slot to check when a lost row needs one
+    uint32_t cache_mask;
+    uint16_t *cache_table;      // slot of a fragment, open addressing by index
+    uint16_t *cache_index;      // fragment held by each slot
+    uint8_t *cache_dirty;       // slot not written to flash yet
+    uint8_t *cache_data;
+    uint32_t cache_hit;         // fragment reads served from the cache
+    uint32_t cache_miss;        // fragment reads passed to frd_func
+
+    /* reconstruction window, cfg.dt past the layout of frag_dec_init */
+    uint8_t *recon_buf;
+    uint16_t recon_slots;
+#ifdef FRAG_STATS
+    frag_dec_stats_t stats;
+#endif
 } frag_dec_t;
 
+typedef struct {
+    uint16_t nb;
+    uint16_t rank;              // nb when the block can be rebuilt
+    uint16_t useful;
+    uint16_t redundant;
+    uint16_t needed;            // expected frames still to receive, FRAG_DEC_NEEDED_NEVER if too many are lost
+} frag_dec_status_t;
+
+#define FRAG_DEC_NEEDED_NEVER       (0xFFFF)
+
+int frag_row_cache_init(frag_row_cache_t *rc, uint8_t *buf, uint32_t len, uint16_t nb, uint16_t rows);
+void frag_row_cache_fill(frag_row_cache_t *rc);
+bm_t *frag_row_cache_get(frag_row_cache_t *rc, uint16_t nb, uint32_t n);
+
 int frag_enc(frag_enc_t *obj, uint8_t *buf, int len, int unit, int cr);
+int frag_enc_layout(frag_enc_t *obj, uint8_t *buf, int len, int unit, int cr);
+int frag_enc_rows(frag_enc_t *obj, uint32_t first, uint32_t last);
+int frag_enc_init(frag_enc_t *obj, uint8_t *buf, int len, int unit);
+int frag_enc_next(frag_enc_t *obj, uint32_t fcnt, uint8_t *out);
 
+int frag_dec_layout(frag_dec_cfg_t *cfg, frag_dec_layout_t *lo);
+int frag_dec_mem_size(frag_dec_cfg_t *cfg);
 int frag_dec_init(frag_dec_t *obj);
 int frag_dec(frag_dec_t *obj, uint16_t fcnt, uint8_t *buf, int len);
+int frag_dec_rank(frag_dec_t *obj);
+void frag_dec_status(frag_dec_t *obj, frag_dec_status_t *st);
 
 void frag_dec_log_bits(bm_t *bitmap, int len);
 void frag_dec_log_buf(uint8_t *buf, int len);
 void frag_dec_log(frag_dec_t *obj);
 
-int m2t_map(int x, int y, int m);
-
 #endif // __FRAGMENTATION_H
@@ -0,0 +1,237 @@
+#ifndef __FRAG_CODEC_H
+#define __FRAG_CODEC_H
+
+#if __cplusplus < 201402L
+#error "frag_codec.h needs C++14 (constexpr loops)"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+#include "frag.h"
+}
+
+/*
+ Codec for one fixed configuration: NB uncoded fragments of SIZE bytes,
+ CR coded ones, up to TOL lost uncoded fragments recovered.
+
+ The parity rows of coded fragments 1 to CR are generated by the compiler
+ into a const table, laid out as a filled frag_row_cache_t, so that it is
+ placed in flash and frag_enc / frag_dec read it without running PRBS23.
+ Fragments past NB + CR are refused rather than generated. The decoder
+ buffers are sized at compile time and held by the object, frag_dec_init
+ only places them; the layout must fit FRAG_CODEC_RAM_MAX.
+
+ Fragments are passed as FragSpan views. The data block is handed to the
+ encoder as a FragBuf, which can only be moved: the caller gets it back
+ from enc_release once the session is over, and can't write it meanwhile.
+ The codec holds pointers into itself and can't be copied or moved, it is
+ meant to be a global.
+ */
+
+#ifndef FRAG_CODEC_RAM_MAX
+#define FRAG_CODEC_RAM_MAX      (16 * 1024)
+#endif
+
+/* view of n elements, not owned */
+template <typename T>
+class FragSpan {
+public:
+    constexpr FragSpan() : p_(NULL), n_(0) {}
+    constexpr FragSpan(T *p, size_t n) : p_(p), n_(n) {}
+    template <size_t N>
+    constexpr FragSpan(T (&a)[N]) : p_(a), n_(N) {}
+    /* FragSpan<uint8_t> to FragSpan<const uint8_t> */
+    template <typename U>
+    constexpr FragSpan(const FragSpan<U> &s) : p_(s.data()), n_(s.size()) {}
+
+    constexpr T *data() const { return p_; }
+    constexpr size_t size() const { return n_; }
+    constexpr T &operator[](size_t i) const { return p_[i]; }
+    constexpr FragSpan subspan(size_t ofs, size_t n) const { return FragSpan(p_ + ofs, n); }
+
+private:
+    T *p_;
+    size_t n_;
+};
+
+/* sole handle of a buffer, moving it leaves the source empty */
+template <typename T>
+class FragBuf {
+public:
+    FragBuf() {}
+    explicit FragBuf(FragSpan<T> s) : s_(s) {}
+    FragBuf(FragBuf &&o) : s_(o.s_) { o.s_ = FragSpan<T>(); }
+    FragBuf &operator=(FragBuf &&o)
+    {
+        if (this != &o) {
+            s_ = o.s_;
+            o.s_ = FragSpan<T>();
+        }
+        return *this;
+    }
+    FragBuf(const FragBuf &) = delete;
+    FragBuf &operator=(const FragBuf &) = delete;
+
+    FragSpan<T> span() const { return s_; }
+    bool empty() const { return s_.data() == NULL; }
+
+private:
+    FragSpan<T> s_;
+};
+
+/* m2t_offset(m, m) of bitmap.h */
+static constexpr uint32_t frag_codec_m2t_words(uint32_t m)
+{
+    return m * ((m + BM_UNIT - 1) >> BM_OFST) -
+           (BM_UNIT * (m >> BM_OFST) * ((m >> BM_OFST) - 1) / 2 + (m >> BM_OFST) * (m & (BM_UNIT - 1)));
+}
+
+/* prbs23 of frag.c */
+static constexpr uint32_t frag_codec_prbs23(uint32_t x)
+{
+    return (x >> 1) + (((x ^ (x >> 5)) & 1) << 22);
+}
+
+/* coded rows 1 to CR of NB fragments, as frag_row_cache_fill leaves the cache */
+template <uint16_t NB, uint16_t CR>
+struct FragRows {
+    bm_t w[FRAG_ROW_CACHE_LEN(NB, CR) / sizeof(bm_t)];
+};
+
+/* matrix_line_bm of frag.c, for every row */
+template <uint16_t NB, uint16_t CR>
+constexpr FragRows<NB, CR> frag_codec_rows()
+{
+    /* C++14 wants every local initialized in a constant expression */
+    FragRows<NB, CR> t = {};
+    uint32_t words = (NB + BM_UNIT - 1) / BM_UNIT;
+    uint32_t mm = NB + (((NB & (NB - 1)) == 0) ? 1 : 0);
+    uint32_t x = 0, r = 0, i = 0, k = 0, n = 0;
+
+    for (i = 0; i < (CR + BM_UNIT - 1) / BM_UNIT; i++) {
+        t.w[i] = ~(bm_t)0;
+    }
+    for (n = 1; n <= CR; n++) {
+        x = 1 + 1001 * n;
+        i = (CR + BM_UNIT - 1) / BM_UNIT + (n - 1) * words;
+        for (k = 0; k < NB / 2; k++) {
+            do {
+                x = frag_codec_prbs23(x);
+                r = x % mm;
+            } while (r >= NB);
+            t.w[i + r / BM_UNIT] |= (bm_t)1 << (r % BM_UNIT);
+        }
+    }
+    return t;
+}
+
+template <uint16_t NB, uint8_t SIZE, uint16_t TOL, uint16_t CR>
+class FragCodec {
+public:
+    static constexpr uint32_t BLOCK_LEN = (uint32_t)NB * SIZE;
+    static constexpr uint32_t ROW_WORDS = (NB + BM_UNIT - 1) / BM_UNIT;
+    /* flash: the parity rows, as frag_row_cache_init lays them out */
+    static constexpr uint32_t ROWS_LEN = FRAG_ROW_CACHE_LEN(NB, CR);
+    /* RAM: frag_dec_layout with a compressed matrix and no fragment cache */
+    static constexpr uint32_t DEC_LEN = 2 * FRAG_DEC_ALIGN_UP(ROW_WORDS * sizeof(bm_t)) +
+                                        FRAG_DEC_ALIGN_UP(frag_codec_m2t_words(TOL) * sizeof(bm_t)) +
+                                        FRAG_DEC_ALIGN_UP((TOL + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t)) +
+                                        2 * FRAG_DEC_ROW_LEN(SIZE);
+
+    static_assert(NB > 0 && SIZE > 0 && CR > 0, "empty block or no coded fragment");
+    static_assert((uint32_t)NB + CR <= FRAG_N_MAX, "more than FRAG_N_MAX fragments");
+    static_assert(TOL <= NB && TOL <= CR, "tolerence above nb or cr");
+    static_assert(DEC_LEN <= FRAG_CODEC_RAM_MAX, "decoder layout over FRAG_CODEC_RAM_MAX");
+
+    FragCodec()
+    {
+        rcache_.nb = NB;
+        rcache_.rows = CR;
+        rcache_.words = ROW_WORDS;
+        /* every valid bit is set, frag_row_cache_get never writes the table */
+        rcache_.valid_bm = const_cast<bm_t *>(rows_.w);
+        rcache_.row_bm = const_cast<bm_t *>(rows_.w) + (CR + BM_UNIT - 1) / BM_UNIT;
+    }
+    FragCodec(const FragCodec &) = delete;
+    FragCodec &operator=(const FragCodec &) = delete;
+
+    /* block: BLOCK_LEN bytes, held until enc_release */
+    int enc_init(FragBuf<const uint8_t> block)
+    {
+        if (block.span().size() != BLOCK_LEN) {
+            return -1;
+        }
+        block_ = static_cast<FragBuf<const uint8_t> &&>(block);
+        enc_.dt = NULL;
+        enc_.maxlen = 0;
+        enc_.rcache = &rcache_;
+        enc_.trace = NULL;
+        /* frag_enc only reads the block */
+        return frag_enc_init(&enc_, const_cast<uint8_t *>(block_.span().data()), BLOCK_LEN, SIZE);
+    }
+
+    /* n: 1 to NB + CR, out: SIZE bytes */
+    int enc_next(uint16_t n, FragSpan<uint8_t> out)
+    {
+        if (block_.empty() || (n < 1) || (n > NB + CR) || (out.size() != SIZE)) {
+            return -1;
+        }
+        return frag_enc_next(&enc_, n, out.data());
+    }
+
+    FragBuf<const uint8_t> enc_release()
+    {
+        return static_cast<FragBuf<const uint8_t> &&>(block_);
+    }
+
+    /* fragment i is kept at faddr + i * SIZE */
+    int dec_init(flash_rd_t frd, flash_wr_t fwr, uint32_t faddr)
+    {
+        dec_.cfg.dt = arena_;
+        dec_.cfg.maxlen = DEC_LEN;
+        dec_.cfg.nb = NB;
+        dec_.cfg.size = SIZE;
+        dec_.cfg.tolerence = TOL;
+        dec_.cfg.faddr = faddr;
+        dec_.cfg.frd_func = frd;
+        dec_.cfg.fwr_func = fwr;
+        dec_.cfg.rcache = &rcache_;
+        dec_.cfg.trace = NULL;
+        dec_.cfg.cache_len = 0;
+        return (frag_dec_init(&dec_) == (int)DEC_LEN) ? 0 : -1;
+    }
+
+    /* n: 1 to NB + CR, frag: SIZE bytes, returns as frag_dec */
+    int dec(uint16_t n, FragSpan<const uint8_t> frag)
+    {
+        if ((n > NB + CR) || (frag.size() != SIZE)) {
+            return FRAG_DEC_ERR_INVALID_FRAME;
+        }
+        /* frag_dec only reads the fragment */
+        return frag_dec(&dec_, n, const_cast<uint8_t *>(frag.data()), SIZE);
+    }
+
+    void dec_status(frag_dec_status_t *st) { frag_dec_status(&dec_, st); }
+
+    /* coded row n (from 1) as matrix_line_bm of frag.c builds it, for checks */
+    static FragSpan<const bm_t> row(uint16_t n)
+    {
+        return FragSpan<const bm_t>(rows_.w + (CR + BM_UNIT - 1) / BM_UNIT + (n - 1) * ROW_WORDS, ROW_WORDS);
+    }
+
+private:
+    static constexpr FragRows<NB, CR> rows_ = frag_codec_rows<NB, CR>();
+
+    frag_row_cache_t rcache_;
+    frag_enc_t enc_;
+    FragBuf<const uint8_t> block_;
+    frag_dec_t dec_;
+    alignas(FRAG_DEC_ALIGN) uint8_t arena_[DEC_LEN];
+};
+
+template <uint16_t NB, uint8_t SIZE, uint16_t TOL, uint16_t CR>
+constexpr FragRows<NB, CR> FragCodec<NB, SIZE, TOL, CR>::rows_;
+
+#endif // __FRAG_CODEC_H
@@ -0,0 +1,73 @@
+#include <string.h>
+#include "frag.h"
+#include "frag_plan.h"
+
+/* the coded rows of one fragment have no coefficient, nb starts at 2 */
+#define FRAG_PLAN_NB_MIN        (2)
+
+int frag_plan(frag_plan_cfg_t *cfg, frag_plan_t *plan)
+{
+    frag_plan_t p;
+    frag_rate_t rc;
+    frag_dec_cfg_t dcfg;
+    uint32_t size, size_max, nb;
+    bool found;
+
+    if ((cfg->len == 0) || (cfg->rc == NULL)) {
+        return FRAG_PLAN_ERR_PARAM;
+    }
+    size_max = (cfg->fsk_bps > 0) ? 255 : FRAG_PLAN_MAX_PAYLOAD(cfg->phy.sf, cfg->phy.bw);
+    if ((cfg->max_payload > 0) && (cfg->max_payload < size_max)) {
+        size_max = cfg->max_payload;
+    }
+    if (size_max <= cfg->overhead) {
+        return FRAG_PLAN_ERR_PARAM;
+    }
+    size_max -= cfg->overhead;
+    /* frag_dec keeps the size in a byte */
+    if (size_max > 255) {
+        size_max = 255;
+    }
+
+    /* the coded fragments are only bounded by the fragment number */
+    rc = *cfg->rc;
+    rc.cfg.cr_min = 1;
+
+    found = false;
+    memset(&dcfg, 0, sizeof(dcfg));
+    for (size = 1; size <= size_max; size++) {
+        nb = (cfg->len + size - 1) / size;
+        if (nb < FRAG_PLAN_NB_MIN) {
+            break;
+        }
+        if (nb >= FRAG_N_MAX) {
+            continue;
+        }
+        rc.cfg.cr_max = FRAG_N_MAX - nb;
+        p.size = size;
+        p.nb = nb;
+        p.cr = frag_rate_cr(&rc, nb);
+        p.tolerence = frag_rate_tolerence(&rc, nb, p.cr);
+        p.pad = nb * size - cfg->len;
+        p.frame_len = cfg->overhead + size;
+        if (cfg->fsk_bps > 0) {
+            p.toa_us = fsk_toa_us(cfg->fsk_bps, cfg->phy.preamble, cfg->phy.fix_len, cfg->phy.crc, p.frame_len);
+        } else {
+            p.toa_us = lora_toa_us(&cfg->phy, p.frame_len);
+        }
+        p.session_us = (uint64_t)(p.nb + p.cr) * p.toa_us;
+
+        dcfg.nb = p.nb;
+        dcfg.size = p.size;
+        dcfg.tolerence = p.tolerence;
+        p.ram = frag_dec_mem_size(&dcfg);
+        if ((cfg->ram > 0) && (p.ram > cfg->ram)) {
+            continue;
+        }
+        if (!found || (p.session_us <= plan->session_us)) {
+            *plan = p;
+            found = true;
+        }
+    }
+    return found ? 0 : FRAG_PLAN_ERR_NONE;
+}
@@ -0,0 +1,63 @@
+#ifndef __FRAG_PLAN_H
+#define __FRAG_PLAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lora_toa.h"
+#include "frag_rate.h"
+
+/*
+ Fragment size planner.
+
+ For a data block of cfg.len bytes, every fragment size that fits a frame
+ is tried: nb = len / size rounded up, cr coded fragments from the rate
+ controller cfg.rc (frag_rate_cr, the expected loss and its margin), and
+ the airtime of nb + cr frames of cfg.overhead + size bytes. The size with
+ the least airtime for the session wins, the larger one on a tie.
+
+ Small fragments pay the preamble, PHY header and cfg.overhead on many
+ frames, large ones round the block up to whole fragments and need more
+ airtime per coded fragment; LoRa also sends payload in blocks of SF
+ bytes, so some sizes fill their last symbols and others do not.
+
+ A LoRa frame is at most the payload the regional parameters allow at the
+ spreading factor (FRAG_PLAN_MAX_PAYLOAD), an FSK frame 255 bytes, and
+ both at most cfg.max_payload.
+ With cfg.ram set, sizes whose decoder (frag_dec_mem_size, with the
+ tolerance of frag_rate_tolerence) does not fit are skipped.
+
+ Both ends of a session must plan with the same inputs, or get nb and
+ size from the sender.
+ */
+
+/* EU868 PHY payload limit: 51 byte application payload at SF10-12 (125 kHz), 115 at SF9, 242 above; 255 at 250 and 500 kHz */
+#define FRAG_PLAN_MAX_PAYLOAD(sf, bw)   ((((bw) > 0) || ((sf) <= 8)) ? 255 : ((sf) == 9) ? 128 : 64)
+
+#define FRAG_PLAN_ERR_PARAM     (-1)
+#define FRAG_PLAN_ERR_NONE      (-2)    // no size fits the frame, fragment number and RAM limits
+
+typedef struct {
+    uint32_t len;               // data block
+    lora_phy_t phy;
+    uint32_t fsk_bps;           // FSK when not 0, phy then only gives preamble, fix_len and crc
+    uint16_t overhead;          // bytes of a frame besides the fragment: FRAG_WIRE_HDR_LEN, MAC header and MIC
+    uint16_t max_payload;       // largest frame, 0 for FRAG_PLAN_MAX_PAYLOAD only
+    uint32_t ram;               // largest decoder buffer, 0 for no limit
+    frag_rate_t *rc;            // expected loss, see frag_rate_init
+} frag_plan_cfg_t;
+
+typedef struct {
+    uint16_t size;
+    uint16_t nb;
+    uint16_t cr;
+    uint16_t tolerence;
+    uint16_t pad;               // zero bytes after the block, to fill the last fragment
+    uint16_t frame_len;         // overhead + size
+    uint32_t ram;               // decoder buffer, frag_dec_mem_size
+    uint32_t toa_us;            // per frame
+    uint64_t session_us;        // (nb + cr) * toa_us
+} frag_plan_t;
+
+int frag_plan(frag_plan_cfg_t *cfg, frag_plan_t *plan);
+
+#endif // __FRAG_PLAN_H
@@ -0,0 +1,161 @@
+#include <math.h>
+#include "frag_rate.h"
+
+#define FRAG_RATE_LOSS_MAX      (0.95f)
+
+void frag_rate_init(frag_rate_t *rc, frag_rate_cfg_t *cfg)
+{
+    rc->cfg = *cfg;
+    if (rc->cfg.burst < 1) {
+        rc->cfg.burst = 1;
+    }
+    rc->slots = rc->cfg.prior;
+    rc->lost = rc->cfg.prior * rc->cfg.loss;
+    rc->runs = rc->lost / rc->cfg.burst;
+    rc->last_fcnt = 0;
+    rc->rssi = 0;
+    rc->snr = 0;
+    rc->frames = 0;
+}
+
+void frag_rate_start(frag_rate_t *rc)
+{
+    rc->last_fcnt = 0;
+}
+
+void frag_rate_rx(frag_rate_t *rc, uint16_t fcnt, int16_t rssi, int8_t snr)
+{
+    uint16_t gap;
+
+    if (rc->frames == 0) {
+        rc->rssi = rssi;
+        rc->snr = snr;
+    } else {
+        rc->rssi += (rssi - rc->rssi) / 8;
+        rc->snr += (snr - rc->snr) / 8;
+    }
+    rc->frames++;
+
+    if (fcnt <= rc->last_fcnt) {
+        /* duplicate, or a new session without frag_rate_start */
+        if (fcnt < rc->last_fcnt) {
+            rc->last_fcnt = fcnt;
+        }
+        return;
+    }
+    gap = fcnt - rc->last_fcnt - 1;
+    rc->last_fcnt = fcnt;
+    if (gap > rc->cfg.window) {
+        /* receiver was away, not a property of the link */
+        return;
+    }
+
+    if (gap > 0) {
+        rc->lost += gap;
+        rc->runs += 1;
+    }
+    rc->slots += gap + 1;
+    while ((rc->cfg.window > 0) && (rc->slots > rc->cfg.window)) {
+        rc->slots /= 2;
+        rc->lost /= 2;
+        rc->runs /= 2;
+    }
+}
+
+float frag_rate_loss(frag_rate_t *rc)
+{
+    float p, m, p_snr;
+
+    p = (rc->slots > 0) ? rc->lost / rc->slots : rc->cfg.loss;
+    if ((rc->frames > 0) && (rc->cfg.snr_margin > 0)) {
+        m = rc->snr - rc->cfg.snr_floor;
+        if (m < rc->cfg.snr_margin) {
+            /* half the frames at the floor, more below it */
+            p_snr = 0.5f * (rc->cfg.snr_margin - m) / rc->cfg.snr_margin;
+            if (p_snr > p) {
+                p = p_snr;
+            }
+        }
+    }
+    if (p > FRAG_RATE_LOSS_MAX) {
+        p = FRAG_RATE_LOSS_MAX;
+    }
+    return p;
+}
+
+float frag_rate_burst(frag_rate_t *rc)
+{
+    float l;
+
+    l = (rc->runs > 0) ? rc->lost / rc->runs : rc->cfg.burst;
+    return (l < 1) ? 1 : l;
+}
+
+/*
+ variance of the loss count per slot: p (1 - p) for independent losses,
+ times (1 + r) / (1 - r) with r the correlation of consecutive slots of
+ the Gilbert channel
+ */
+static float frag_rate_var(frag_rate_t *rc, float p)
+{
+    float p_bg, p_gb, r;
+
+    p_bg = 1 / frag_rate_burst(rc);
+    p_gb = (p < 1) ? p * p_bg / (1 - p) : 1;
+    r = 1 - p_gb - p_bg;
+    if (r > 0.99f) {
+        r = 0.99f;
+    }
+    return p * (1 - p) * (1 + r) / (1 - r);
+}
+
+/*
+ standard deviation of the losses over n slots, the error of the loss rate
+ measured over rc->slots slots included
+ */
+static float frag_rate_sd(frag_rate_t *rc, float n, float var)
+{
+    float w;
+
+    w = (rc->slots > 1) ? rc->slots : 1;
+    return sqrtf(n * var * (1 + n / w));
+}
+
+uint16_t frag_rate_cr(frag_rate_t *rc, uint16_t nb)
+{
+    float p, var, n;
+    uint32_t cr;
+
+    p = frag_rate_loss(rc);
+    var = frag_rate_var(rc, p);
+    for (cr = rc->cfg.cr_min; cr < rc->cfg.cr_max; cr++) {
+        n = (float)nb + cr;
+        if (n * (1 - p) - rc->cfg.sigma * frag_rate_sd(rc, n, var) >= (float)nb + rc->cfg.overhead) {
+            break;
+        }
+    }
+    return cr;
+}
+
+uint16_t frag_rate_tolerence(frag_rate_t *rc, uint16_t nb, uint16_t cr)
+{
+    float p, var, t;
+    uint32_t tol;
+
+    p = frag_rate_loss(rc);
+    var = frag_rate_var(rc, p);
+    /*
+     a session lost to the tolerance costs as much as one lost to the coding
+     rate, the tolerance takes one more standard deviation
+     */
+    t = ceilf(nb * p + (rc->cfg.sigma + 1) * frag_rate_sd(rc, nb, var));
+    tol = (t > 0) ? (uint32_t)t : 0;
+    /* more lost fragments than coded ones can never be recovered */
+    if (tol > cr) {
+        tol = cr;
+    }
+    if (tol > nb) {
+        tol = nb;
+    }
+    return tol;
+}
@@ -0,0 +1,68 @@
+#ifndef __FRAG_RATE_H
+#define __FRAG_RATE_H
+
+#include <stdint.h>
+
+/*
+ Coding rate controller.
+
+ The receiver feeds it the frame counter, RSSI and SNR of every frame it
+ gets. Gaps in the counter are losses; the controller keeps a decaying
+ window of sent slots, lost slots and loss bursts, from which it derives
+ the loss rate and the mean burst length (two state Gilbert channel).
+
+ frag_rate_cr returns the number of coded fragments for a block of nb so
+ that, with the measured channel, at least nb + cfg.overhead frames get
+ through with cfg.sigma standard deviations of margin. Bursty losses
+ widen the spread of the received count, so they need more coded
+ fragments than independent ones at the same loss rate.
+ frag_rate_tolerence returns the lost uncoded fragments to reserve in the
+ decoder (cfg.tolerence of frag_dec) with the same margin.
+
+ When the SNR average comes within cfg.snr_margin dB of cfg.snr_floor,
+ the demodulation limit of the spreading factor, the loss rate used is
+ raised ahead of the measured one, which lags a fading link.
+ */
+
+typedef struct {
+    float loss;                 // prior loss rate, used until frames are seen
+    float burst;                // prior mean burst length, 1 for independent losses
+    uint16_t prior;             // weight of the prior, in slots
+    uint16_t window;            // counters are halved past this many slots
+    uint16_t cr_min;
+    uint16_t cr_max;
+    uint16_t overhead;          // frames received beyond nb, frag_dec usually needs 1 or 2
+    float sigma;                // margin in standard deviations, 2.33 for about 99%
+    float snr_floor;            // dB, -7.5 at SF7, 2.5 dB lower per SF step
+    float snr_margin;           // dB
+} frag_rate_cfg_t;
+
+typedef struct {
+    frag_rate_cfg_t cfg;
+
+    float slots;                // frames sent in the window, lost ones included
+    float lost;
+    float runs;                 // loss bursts
+    uint16_t last_fcnt;         // 0 before the first frame of a session
+
+    float rssi;                 // averages, valid once frames > 0
+    float snr;
+    uint32_t frames;            // frames seen since init
+} frag_rate_t;
+
+#define FRAG_RATE_SNR_FLOOR(sf)     (-7.5f - 2.5f * ((sf) - 7))
+
+void frag_rate_init(frag_rate_t *rc, frag_rate_cfg_t *cfg);
+/* a new session starts, its frame counter restarts from 1 */
+void frag_rate_start(frag_rate_t *rc);
+/* fcnt: frame counter of frag_dec, from 1 */
+void frag_rate_rx(frag_rate_t *rc, uint16_t fcnt, int16_t rssi, int8_t snr);
+
+/* loss rate and mean burst length, the SNR adjustment included */
+float frag_rate_loss(frag_rate_t *rc);
+float frag_rate_burst(frag_rate_t *rc);
+
+uint16_t frag_rate_cr(frag_rate_t *rc, uint16_t nb);
+uint16_t frag_rate_tolerence(frag_rate_t *rc, uint16_t nb, uint16_t cr);
+
+#endif // __FRAG_RATE_H
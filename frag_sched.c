@@ -0,0 +1,98 @@
+#include <string.h>
+#include "frag_sched.h"
+
+#define FRAG_SCHED_RING         (FRAG_SCHED_SLOTS + 1)
+
+int frag_sched_init(frag_sched_t *s, frag_sched_cfg_t *cfg)
+{
+    memset(s, 0, sizeof(*s));
+    s->cfg = *cfg;
+    s->slot_ms = cfg->window_ms / FRAG_SCHED_SLOTS;
+    s->budget_us = (uint32_t)((uint64_t)cfg->window_ms * cfg->duty_pm);
+    if ((s->slot_ms == 0) || (cfg->toa_us == 0) || (cfg->toa_us > s->budget_us)) {
+        return -1;
+    }
+    return 0;
+}
+
+static uint32_t frag_sched_toa_ms(frag_sched_t *s)
+{
+    return (s->cfg.toa_us + 999) / 1000;
+}
+
+/* drop the slots that left the window */
+static void frag_sched_advance(frag_sched_t *s, uint32_t now_ms)
+{
+    uint32_t b;
+
+    b = now_ms / s->slot_ms;
+    if ((int32_t)(b - s->cur) <= 0) {
+        return;
+    }
+    if (b - s->cur >= FRAG_SCHED_RING) {
+        memset(s->slot_us, 0, sizeof(s->slot_us));
+        s->used_us = 0;
+        s->cur = b;
+        return;
+    }
+    while (s->cur != b) {
+        s->cur++;
+        s->used_us -= s->slot_us[s->cur % FRAG_SCHED_RING];
+        s->slot_us[s->cur % FRAG_SCHED_RING] = 0;
+    }
+}
+
+uint32_t frag_sched_delay(frag_sched_t *s, uint32_t now_ms)
+{
+    uint32_t d, i, k, used, expire;
+
+    frag_sched_advance(s, now_ms);
+    d = 0;
+    if ((s->sent > 0) && ((int32_t)(s->free_ms - now_ms) > 0)) {
+        d = s->free_ms - now_ms;
+    }
+    if (s->used_us + s->cfg.toa_us <= s->budget_us) {
+        return d;
+    }
+    /* wait for the oldest slots to leave until the frame fits */
+    used = s->used_us;
+    for (i = 0; i < FRAG_SCHED_RING; i++) {
+        /* oldest first, slot k - FRAG_SCHED_RING leaves the window when slot k starts */
+        k = s->cur + 1 + i;
+        used -= s->slot_us[k % FRAG_SCHED_RING];
+        if (used + s->cfg.toa_us <= s->budget_us) {
+            expire = k * s->slot_ms;
+            if (expire - now_ms > d) {
+                d = expire - now_ms;
+            }
+            break;
+        }
+    }
+    return d;
+}
+
+void frag_sched_sent(frag_sched_t *s, uint32_t now_ms)
+{
+    frag_sched_advance(s, now_ms);
+    s->slot_us[s->cur % FRAG_SCHED_RING] += s->cfg.toa_us;
+    s->used_us += s->cfg.toa_us;
+    s->free_ms = now_ms + frag_sched_toa_ms(s) + s->cfg.gap_ms;
+    s->sent++;
+}
+
+uint32_t frag_sched_eta(frag_sched_t *s, uint32_t now_ms, uint32_t frames)
+{
+    frag_sched_t tmp;
+    uint32_t t, i;
+
+    if (frames == 0) {
+        return 0;
+    }
+    tmp = *s;
+    t = now_ms;
+    for (i = 0; i < frames; i++) {
+        t += frag_sched_delay(&tmp, t);
+        frag_sched_sent(&tmp, t);
+    }
+    return t + frag_sched_toa_ms(s) - now_ms;
+}
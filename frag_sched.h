@@ -0,0 +1,52 @@
+#ifndef __FRAG_SCHED_H
+#define __FRAG_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Duty cycle aware pacing of fragment frames.
+
+ Frames go back to back, cfg.gap_ms apart, as long as the airtime sent in
+ the last cfg.window_ms stays within cfg.duty_pm of it (ETSI EN 300 220:
+ 1% over one hour in the 868.0 - 868.6 MHz sub-band). The window is kept
+ as FRAG_SCHED_SLOTS slots plus the current one, and a frame is counted
+ until its whole slot has left the window, so the limit is never
+ exceeded.
+
+ Times are in ms on the caller's clock, which may wrap only after the
+ session (about 49 days for a 32-bit ms counter).
+ */
+
+#ifndef FRAG_SCHED_SLOTS
+#define FRAG_SCHED_SLOTS        (60)
+#endif
+
+typedef struct {
+    uint32_t toa_us;            // airtime of one frame, see lora_toa_us
+    uint16_t duty_pm;           // per mille, 10 for 1%
+    uint32_t window_ms;
+    uint32_t gap_ms;            // from the end of a frame to the start of the next one
+} frag_sched_cfg_t;
+
+typedef struct {
+    frag_sched_cfg_t cfg;
+
+    uint32_t slot_ms;
+    uint32_t budget_us;         // airtime allowed in a window
+    uint32_t used_us;           // airtime in the slots
+    uint32_t cur;               // slot of the newest entry, now / slot_ms
+    uint32_t slot_us[FRAG_SCHED_SLOTS + 1];
+    uint32_t free_ms;           // end of the last frame plus the gap
+    uint32_t sent;
+} frag_sched_t;
+
+int frag_sched_init(frag_sched_t *s, frag_sched_cfg_t *cfg);
+/* ms to wait from now before the next frame may start */
+uint32_t frag_sched_delay(frag_sched_t *s, uint32_t now_ms);
+/* a frame starts now */
+void frag_sched_sent(frag_sched_t *s, uint32_t now_ms);
+/* ms from now until the end of the last of frames more frames */
+uint32_t frag_sched_eta(frag_sched_t *s, uint32_t now_ms, uint32_t frames);
+
+#endif // __FRAG_SCHED_H
@@ -0,0 +1,299 @@
+#include "frag_store.h"
+
+#define FRAG_STORE_REC_HDR      (4)
+
+static uint32_t frag_store_data_sectors(frag_store_cfg_t *cfg)
+{
+    return ((uint32_t)cfg->nb * cfg->size + cfg->sector_size - 1) / cfg->sector_size;
+}
+
+static uint16_t frag_store_rec_max(frag_store_cfg_t *cfg)
+{
+    uint32_t n;
+
+    n = (uint32_t)cfg->log_sectors * cfg->sector_size / (FRAG_STORE_REC_HDR + cfg->size);
+    return (n > 0xFFFF) ? 0xFFFF : n;
+}
+
+uint32_t frag_store_flash_size(frag_store_cfg_t *cfg)
+{
+    return (frag_store_data_sectors(cfg) + cfg->log_sectors + 1) * cfg->sector_size;
+}
+
+int frag_store_mem_size(frag_store_cfg_t *cfg)
+{
+    int i;
+
+    i = 0;
+    i += 2 * ((cfg->nb + BM_UNIT - 1) / BM_UNIT * sizeof(bm_t));
+    i += frag_store_rec_max(cfg) * sizeof(uint16_t);
+    i += FRAG_STORE_REC_HDR + cfg->size;
+    return i;
+}
+
+/* program len bytes, split at page boundaries */
+static int frag_store_prog(frag_store_t *st, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    uint32_t n;
+
+    while (len > 0) {
+        n = st->cfg.page_size - addr % st->cfg.page_size;
+        if (n > len) {
+            n = len;
+        }
+        if (st->cfg.wr_func(addr, buf, n) < 0) {
+            return FRAG_STORE_ERR_FLASH;
+        }
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* erase one sector, blank ones are left alone to save wear */
+static int frag_store_erase(frag_store_t *st, uint32_t addr, bool check)
+{
+    uint32_t ofs, n, i;
+
+    if (check) {
+        for (ofs = 0; ofs < st->cfg.sector_size; ofs += n) {
+            n = st->cfg.sector_size - ofs;
+            if (n > st->rec_len) {
+                n = st->rec_len;
+            }
+            if (st->cfg.rd_func(addr + ofs, st->buf, n) < 0) {
+                return FRAG_STORE_ERR_FLASH;
+            }
+            for (i = 0; i < n; i++) {
+                if (st->buf[i] != 0xFF) {
+                    break;
+                }
+            }
+            if (i < n) {
+                break;
+            }
+        }
+        if (ofs >= st->cfg.sector_size) {
+            return 0;
+        }
+    }
+    st->erase_cnt++;
+    if (st->cfg.er_func(addr) < 0) {
+        return FRAG_STORE_ERR_FLASH;
+    }
+    return 0;
+}
+
+int frag_store_init(frag_store_t *st)
+{
+    uint32_t i, sectors;
+    int len;
+
+    if ((st->cfg.page_size == 0) || (st->cfg.sector_size == 0) || (st->cfg.log_sectors == 0) ||
+        ((st->cfg.addr % st->cfg.sector_size) != 0) || (st->cfg.size == 0)) {
+        return FRAG_STORE_ERR_PARAM;
+    }
+    /* bitmaps are accessed by bm_t words */
+    if (((uintptr_t)st->cfg.dt % sizeof(bm_t)) != 0) {
+        return FRAG_STORE_ERR_PARAM;
+    }
+    len = frag_store_mem_size(&st->cfg);
+    if ((uint32_t)len > st->cfg.maxlen) {
+        return FRAG_STORE_ERR_PARAM;
+    }
+    memset(st->cfg.dt, 0, len);
+
+    st->data_sectors = frag_store_data_sectors(&st->cfg);
+    st->log_addr = st->cfg.addr + st->data_sectors * st->cfg.sector_size;
+    st->spare_addr = st->log_addr + st->cfg.log_sectors * st->cfg.sector_size;
+    st->rec_len = FRAG_STORE_REC_HDR + st->cfg.size;
+    st->rec_max = frag_store_rec_max(&st->cfg);
+    st->rec_cnt = 0;
+    if (st->rec_max == 0) {
+        return FRAG_STORE_ERR_PARAM;
+    }
+
+    st->written_bm = (bm_t *)st->cfg.dt;
+    st->log_bm = st->written_bm + (st->cfg.nb + BM_UNIT - 1) / BM_UNIT;
+    st->rec_index = (uint16_t *)(st->log_bm + (st->cfg.nb + BM_UNIT - 1) / BM_UNIT);
+    st->buf = (uint8_t *)(st->rec_index + st->rec_max);
+
+    st->wr_cnt = 0;
+    st->log_cnt = 0;
+    st->compact_cnt = 0;
+    st->erase_cnt = 0;
+
+    sectors = st->data_sectors + st->cfg.log_sectors + 1;
+    for (i = 0; i < sectors; i++) {
+        if (frag_store_erase(st, st->cfg.addr + i * st->cfg.sector_size, true) < 0) {
+            return FRAG_STORE_ERR_FLASH;
+        }
+    }
+    return len;
+}
+
+static int frag_store_index(frag_store_t *st, uint32_t addr, uint32_t len)
+{
+    if ((len != st->cfg.size) || ((addr % st->cfg.size) != 0) || (addr / st->cfg.size >= st->cfg.nb)) {
+        return FRAG_STORE_ERR_PARAM;
+    }
+    return addr / st->cfg.size;
+}
+
+int frag_store_read(frag_store_t *st, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    int index, r;
+
+    index = frag_store_index(st, addr, len);
+    if (index < 0) {
+        return index;
+    }
+    if (bit_get(st->log_bm, index)) {
+        /* the last record of a fragment is its newest copy */
+        for (r = st->rec_cnt - 1; r >= 0; r--) {
+            if (st->rec_index[r] == index) {
+                break;
+            }
+        }
+        addr = st->log_addr + r * st->rec_len + FRAG_STORE_REC_HDR;
+    } else {
+        addr += st->cfg.addr;
+    }
+    if (st->cfg.rd_func(addr, buf, len) < 0) {
+        return FRAG_STORE_ERR_FLASH;
+    }
+    return 0;
+}
+
+int frag_store_write(frag_store_t *st, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    int index, ret;
+
+    index = frag_store_index(st, addr, len);
+    if (index < 0) {
+        return index;
+    }
+    st->wr_cnt++;
+
+    if (!bit_get(st->written_bm, index) && ((st->cfg.lost_bm == NULL) || !bit_get(st->cfg.lost_bm, index))) {
+        /* first copy, the data area is still erased there */
+        bit_set(st->written_bm, index);
+        return frag_store_prog(st, st->cfg.addr + addr, buf, len);
+    }
+
+    if (st->rec_cnt == st->rec_max) {
+        ret = frag_store_compact(st);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    st->buf[0] = (uint8_t)index;
+    st->buf[1] = (uint8_t)(index >> 8);
+    st->buf[2] = ~st->buf[0];
+    st->buf[3] = ~st->buf[1];
+    memcpy(st->buf + FRAG_STORE_REC_HDR, buf, len);
+    ret = frag_store_prog(st, st->log_addr + st->rec_cnt * st->rec_len, st->buf, st->rec_len);
+    if (ret < 0) {
+        return ret;
+    }
+    st->rec_index[st->rec_cnt++] = index;
+    bit_set(st->log_bm, index);
+    st->log_cnt++;
+    return 0;
+}
+
+/*
+ rebuild data sector s with the newest copy of every fragment it holds:
+ the sector is assembled in the spare sector, erased, copied back from the
+ spare, and the spare is erased again
+ */
+static int frag_store_compact_sector(frag_store_t *st, uint32_t s)
+{
+    uint32_t start, end, lo, hi, first, last, i;
+    uint32_t size;
+
+    size = st->cfg.size;
+    start = s * st->cfg.sector_size;
+    end = start + st->cfg.sector_size;
+    first = start / size;
+    last = (end - 1) / size;
+    if (last >= st->cfg.nb) {
+        last = st->cfg.nb - 1;
+    }
+
+    for (i = first; i <= last; i++) {
+        if (bit_get(st->log_bm, i)) {
+            break;
+        }
+    }
+    if (i > last) {
+        return 0;
+    }
+
+    for (i = first; i <= last; i++) {
+        if (!bit_get(st->written_bm, i)) {
+            continue;
+        }
+        lo = (i * size > start) ? i * size : start;
+        hi = ((i + 1) * size < end) ? (i + 1) * size : end;
+        if ((frag_store_read(st, i * size, st->buf, size) < 0) ||
+            (frag_store_prog(st, st->spare_addr + lo - start, st->buf + lo - i * size, hi - lo) < 0)) {
+            return FRAG_STORE_ERR_FLASH;
+        }
+    }
+    if (frag_store_erase(st, st->cfg.addr + start, false) < 0) {
+        return FRAG_STORE_ERR_FLASH;
+    }
+    for (i = first; i <= last; i++) {
+        if (!bit_get(st->written_bm, i)) {
+            continue;
+        }
+        lo = (i * size > start) ? i * size : start;
+        hi = ((i + 1) * size < end) ? (i + 1) * size : end;
+        if ((st->cfg.rd_func(st->spare_addr + lo - start, st->buf, hi - lo) < 0) ||
+            (frag_store_prog(st, st->cfg.addr + lo, st->buf, hi - lo) < 0)) {
+            return FRAG_STORE_ERR_FLASH;
+        }
+    }
+    return frag_store_erase(st, st->spare_addr, false);
+}
+
+/* merge the log into the data area and erase the used log sectors */
+int frag_store_compact(frag_store_t *st)
+{
+    uint32_t s, used;
+    int i;
+
+    if (st->rec_cnt == 0) {
+        return 0;
+    }
+    /* fragments only found in the log go to their erased slot directly */
+    for (i = 0; i < st->cfg.nb; i++) {
+        if (!bit_get(st->log_bm, i) || bit_get(st->written_bm, i)) {
+            continue;
+        }
+        if ((frag_store_read(st, i * st->cfg.size, st->buf, st->cfg.size) < 0) ||
+            (frag_store_prog(st, st->cfg.addr + i * st->cfg.size, st->buf, st->cfg.size) < 0)) {
+            return FRAG_STORE_ERR_FLASH;
+        }
+        bit_set(st->written_bm, i);
+        bit_clr(st->log_bm, i);
+    }
+    for (s = 0; s < st->data_sectors; s++) {
+        if (frag_store_compact_sector(st, s) < 0) {
+            return FRAG_STORE_ERR_FLASH;
+        }
+    }
+    /* the log is only cleared once all sectors are rebuilt, a fragment may span two of them */
+    used = ((uint32_t)st->rec_cnt * st->rec_len + st->cfg.sector_size - 1) / st->cfg.sector_size;
+    for (s = 0; s < used; s++) {
+        if (frag_store_erase(st, st->log_addr + s * st->cfg.sector_size, false) < 0) {
+            return FRAG_STORE_ERR_FLASH;
+        }
+    }
+    bit_clear_all(st->log_bm, st->cfg.nb);
+    st->rec_cnt = 0;
+    st->compact_cnt++;
+    return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef __FRAG_STORE_H
+#define __FRAG_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "frag.h"
+
+/*
+ Log structured fragment storage on NOR flash, between frag_dec and the
+ flash driver.
+
+ The first write of a fragment goes in place, at index * size in the data
+ area, which is erased by frag_store_init. The decoder rewrites the rows of
+ lost fragments during elimination and back substitution, those rewrites
+ are appended to a log instead of erasing the sector. frag_store_compact
+ merges the log back into the data area, it runs when the log is full and
+ should be called once frag_dec returns the reconstructed block, so the
+ block is then found in place.
+
+ With cfg.lost_bm pointing to the decoder's lost_frm_bm, the rows of lost
+ fragments go to the log from their first write. Their slots in the data
+ area are still erased at the end, so the compaction programs them without
+ erasing any data sector.
+
+ flash layout from cfg.addr: data sectors, cfg.log_sectors log sectors,
+ one spare sector used by the compaction.
+
+ Writes are split at page boundaries, bytes are only programmed once per
+ erase. The log index is kept in RAM like the decoder state, so a session
+ does not survive a reset.
+ */
+
+typedef int (*flash_er_t)(uint32_t addr);
+
+typedef struct {
+    uint8_t *dt;
+    uint32_t maxlen;
+    uint32_t addr;              // flash address of the data area, sector aligned
+    uint32_t page_size;         // a program never crosses a page
+    uint32_t sector_size;       // erase unit
+    uint16_t nb;
+    uint8_t size;
+    uint16_t log_sectors;
+    flash_rd_t rd_func;
+    flash_wr_t wr_func;
+    flash_er_t er_func;
+    bm_t *lost_bm;              // optional, frag_dec_t.lost_frm_bm after frag_dec_init
+} frag_store_cfg_t;
+
+typedef struct {
+    frag_store_cfg_t cfg;
+
+    uint32_t data_sectors;
+    uint32_t log_addr;
+    uint32_t spare_addr;
+    uint16_t rec_len;           // log record: index, ~index, fragment
+    uint16_t rec_max;
+    uint16_t rec_cnt;
+
+    bm_t *written_bm;           // fragments programmed in the data area
+    bm_t *log_bm;               // fragments with a newer copy in the log
+    uint16_t *rec_index;        // fragment of each log record
+    uint8_t *buf;               // one log record
+
+    uint32_t wr_cnt;            // fragments written by the decoder
+    uint32_t log_cnt;           // of which appended to the log
+    uint32_t compact_cnt;
+    uint32_t erase_cnt;         // sectors erased by the store
+} frag_store_t;
+
+#define FRAG_STORE_ERR_PARAM        (-1)
+#define FRAG_STORE_ERR_FLASH        (-2)
+
+/* flash bytes taken from cfg->addr */
+uint32_t frag_store_flash_size(frag_store_cfg_t *cfg);
+/* bytes of cfg->dt frag_store_init takes */
+int frag_store_mem_size(frag_store_cfg_t *cfg);
+
+int frag_store_init(frag_store_t *st);
+/* same arguments as flash_rd_t / flash_wr_t, addr from 0 with frag_dec cfg.faddr = 0 */
+int frag_store_read(frag_store_t *st, uint32_t addr, uint8_t *buf, uint32_t len);
+int frag_store_write(frag_store_t *st, uint32_t addr, uint8_t *buf, uint32_t len);
+int frag_store_compact(frag_store_t *st);
+
+#endif // __FRAG_STORE_H
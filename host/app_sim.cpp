@@ -0,0 +1,218 @@
+/*
+ End to end run of the main.cpp demo on the simulated radio (radio_sim.c).
+
+ Build (from the repository root):
+   gcc -O2 -c -I. -Ihost -Ihost/sim -include host/sim/stdio_sim.h frag.c bitmap.c xorbuf.c frag_rate.c frag_sched.c frag_plan.c evq.c packets.c lora_toa.c trace.c
+   gcc -O2 -c -I. -Ihost -Ihost/sim host/radio_sim.c
+   g++ -O2 -pthread -I. -Ihost -Ihost/sim -o app_sim host/app_sim.cpp \
+       frag.o bitmap.o xorbuf.o frag_rate.o frag_sched.o frag_plan.o evq.o packets.o lora_toa.o trace.o radio_sim.o -lm
+
+ Usage:
+   app_sim [-s slaves] [-l loss,...] [-r seed] [-t seconds] [-i idle_seconds] [-v]
+
+ main.cpp is built once as the master and once per slave, each in its own
+ namespace, and all of them run on one virtual clock. The master's frames
+ reach slave k with loss k of -l (the last one is repeated). The run stops
+ when every slave has decoded the block, when the master has been silent
+ for idle_seconds after its last frame, or at the time limit. -v shows the
+ output of the nodes, with the trace dumps host/trace_dec.c -x reads.
+
+ Reported: frames and airtime of the master, and for every slave the frames
+ received, lost and missed, and the time from the first frame sent to the
+ decoded block. For every node, the interrupts that woke it from sleep and
+ the share of the run it spent asleep.
+*/
+#include "mbed.h"
+#include "sx1276-hal.h"
+
+extern "C" {
+#include "frag.h"
+#include "frag_rate.h"
+#include "frag_sched.h"
+#include "frag_plan.h"
+#include "evq.h"
+#include "packets.h"
+#include "trace.h"
+#include "radio_sim.h"
+}
+
+namespace sim_master {
+#define IS_MASTER (1)
+#include "main.cpp"
+#undef IS_MASTER
+}
+
+#undef __MAIN_H__
+namespace sim_slave0 {
+#define IS_MASTER (0)
+#include "main.cpp"
+#undef IS_MASTER
+}
+
+#undef __MAIN_H__
+namespace sim_slave1 {
+#define IS_MASTER (0)
+#include "main.cpp"
+#undef IS_MASTER
+}
+
+#undef __MAIN_H__
+namespace sim_slave2 {
+#define IS_MASTER (0)
+#include "main.cpp"
+#undef IS_MASTER
+}
+
+#undef __MAIN_H__
+namespace sim_slave3 {
+#define IS_MASTER (0)
+#include "main.cpp"
+#undef IS_MASTER
+}
+
+#undef printf
+
+#define APP_SIM_MAX_SLAVES      (4)
+#define APP_SIM_MAX_LIST        (APP_SIM_MAX_SLAVES)
+
+static radio_sim_main_t slave_main[APP_SIM_MAX_SLAVES] = {
+    sim_slave0::main, sim_slave1::main, sim_slave2::main, sim_slave3::main,
+};
+
+static frag_dec_t *slave_dec[APP_SIM_MAX_SLAVES] = {
+    &sim_slave0::decobj, &sim_slave1::decobj, &sim_slave2::decobj, &sim_slave3::decobj,
+};
+
+typedef struct {
+    radio_sim_node_t *master;
+    radio_sim_node_t *slave[APP_SIM_MAX_SLAVES];
+    int slaves;
+    uint64_t done_us[APP_SIM_MAX_SLAVES];   // 0 while decoding
+    uint64_t idle_us;
+} app_sim_t;
+
+static bool app_sim_stop(void *arg)
+{
+    app_sim_t *app = (app_sim_t *)arg;
+    uint64_t now;
+    int i, done;
+
+    now = radio_sim_now();
+    done = 0;
+    for (i = 0; i < app->slaves; i++) {
+        if ((app->done_us[i] == 0) && (slave_dec[i]->sta == FRAG_DEC_STA_DONE)) {
+            app->done_us[i] = now;
+        }
+        done += app->done_us[i] != 0;
+    }
+    if (done == app->slaves) {
+        return true;
+    }
+    return (app->master->stats.tx_frames > 0) && (now > app->master->stats.last_tx_us + app->idle_us);
+}
+
+static int parse_doubles(const char *arg, double *out)
+{
+    int cnt = 0;
+    char *end;
+    while (*arg && cnt < APP_SIM_MAX_LIST) {
+        out[cnt++] = strtod(arg, &end);
+        if (*end != ',') {
+            break;
+        }
+        arg = end + 1;
+    }
+    return cnt;
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [-s slaves] [-l loss,...] [-r seed] [-t seconds] [-i idle_seconds] [-v]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *slave_name[APP_SIM_MAX_SLAVES] = {"slave0", "slave1", "slave2", "slave3"};
+    app_sim_t app;
+    frag_dec_status_t st;
+    radio_sim_stats_t *ms, *ss;
+    double loss[APP_SIM_MAX_LIST];
+    double limit, idle;
+    uint64_t end;
+    uint32_t seed;
+    int i, loss_cnt;
+    bool verbose;
+
+    memset(&app, 0, sizeof(app));
+    app.slaves = 1;
+    loss[0] = 0.1;
+    loss_cnt = 1;
+    seed = 0x12345678;
+    limit = 3600;
+    idle = 30;
+    verbose = false;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+            continue;
+        }
+        if ((argv[i][0] != '-') || (i + 1 >= argc)) {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+        case 's':
+            app.slaves = atoi(argv[++i]);
+            break;
+        case 'l':
+            loss_cnt = parse_doubles(argv[++i], loss);
+            break;
+        case 'r':
+            seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+            break;
+        case 't':
+            limit = strtod(argv[++i], NULL);
+            break;
+        case 'i':
+            idle = strtod(argv[++i], NULL);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((app.slaves < 1) || (app.slaves > APP_SIM_MAX_SLAVES) || (loss_cnt < 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    radio_sim_init(seed);
+    app.master = radio_sim_add("master", sim_master::main, !verbose);
+    for (i = 0; i < app.slaves; i++) {
+        app.slave[i] = radio_sim_add(slave_name[i], slave_main[i], !verbose);
+        radio_sim_link(app.master, app.slave[i], loss[(i < loss_cnt) ? i : loss_cnt - 1], -80, 5);
+    }
+    app.idle_us = (uint64_t)(idle * 1e6);
+    end = radio_sim_run((uint64_t)(limit * 1e6), app_sim_stop, &app);
+
+    ms = &app.master->stats;
+    printf("\nstopped at %.3f s\n", end / 1e6);
+    printf("master: %u frames, %.3f s on air, first frame at %.3f s, %u wakeups, asleep %.1f%%\n",
+           ms->tx_frames, ms->tx_air_us / 1e6, ms->first_tx_us / 1e6,
+           ms->wakeups, end ? 100.0 * ms->sleep_us / end : 0.0);
+    for (i = 0; i < app.slaves; i++) {
+        ss = &app.slave[i]->stats;
+        frag_dec_status(slave_dec[i], &st);
+        printf("%s: %u received, %u lost, %u missed, rank %u/%u, ",
+               slave_name[i], ss->rx_frames, ss->rx_lost, ss->rx_missed, st.rank, st.nb);
+        if (app.done_us[i] != 0) {
+            printf("decoded, transfer %.3f s\n", (app.done_us[i] - ms->first_tx_us) / 1e6);
+        } else {
+            printf("not decoded\n");
+        }
+        printf("%s: %u wakeups, asleep %.1f%%\n", slave_name[i], ss->wakeups, end ? 100.0 * ss->sleep_us / end : 0.0);
+    }
+    /* the node threads are parked in their main loops */
+    fflush(stdout);
+    _Exit(0);
+}
@@ -0,0 +1,219 @@
+/*
+ Check and time the fixed configuration codec of frag_codec.h.
+
+ Build (from the repository root):
+   gcc -O2 -c frag.c bitmap.c xorbuf.c
+   g++ -O2 -std=c++14 -I. -o codec_bench host/codec_bench.cpp frag.o bitmap.o xorbuf.o
+
+ Usage:
+   codec_bench [-l loss] [-i trials] [-r seed]
+
+ For a few FragCodec<NB, SIZE, TOL, CR> instances, the parity rows built by
+ the compiler are compared with the rows frag.c generates at runtime, and
+ every fragment of FragCodec::enc_next with the one of frag_enc. Then
+ trials blocks are sent through an i.i.d. channel with the given loss and
+ decoded both by FragCodec and by frag_dec without a row cache. Reported:
+   rom          bytes of the parity table
+   ram          bytes of the decoder layout
+   ok           blocks decoded and equal to the sent one, by both decoders
+   codec / c    mean decoding time per block (us)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "frag_codec.h"
+
+#define BENCH_BLOCK_MAX         (1024 * 51)
+
+static uint8_t flash_buf[BENCH_BLOCK_MAX];
+
+static int flash_write(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    memcpy(flash_buf + addr, buf, len);
+    return 0;
+}
+
+static int flash_read(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    memcpy(buf, flash_buf + addr, len);
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* xorshift32, channel and data generator */
+static uint32_t rnd_next(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return x;
+}
+
+static double rnd_unit(uint32_t *s)
+{
+    return (rnd_next(s) >> 8) / (double)(1 << 24);
+}
+
+/* rows and fragments of the codec against frag.c, 0 if they all match */
+template <uint16_t NB, uint8_t SIZE, uint16_t TOL, uint16_t CR>
+static int bench_check(FragCodec<NB, SIZE, TOL, CR> *codec, uint8_t *block)
+{
+    typedef FragCodec<NB, SIZE, TOL, CR> codec_t;
+    static uint8_t rc_buf[codec_t::ROWS_LEN] __attribute__((aligned(FRAG_DEC_ALIGN)));
+    static uint8_t enc_buf[codec_t::BLOCK_LEN + CR * SIZE + FRAG_ENC_LINE_LEN(NB)];
+    frag_row_cache_t rc;
+    frag_enc_t ref;
+    uint8_t out[SIZE];
+    int n, ret;
+
+    if (frag_row_cache_init(&rc, rc_buf, sizeof(rc_buf), NB, CR) < 0) {
+        return -1;
+    }
+    frag_row_cache_fill(&rc);
+    for (n = 1; n <= CR; n++) {
+        if (memcmp(codec_t::row(n).data(), frag_row_cache_get(&rc, NB, n), codec_t::ROW_WORDS * sizeof(bm_t)) != 0) {
+            printf("row %d differs\n", n);
+            return -1;
+        }
+    }
+
+    memset(&ref, 0, sizeof(ref));
+    ref.dt = enc_buf;
+    ref.maxlen = sizeof(enc_buf);
+    if (frag_enc(&ref, block, codec_t::BLOCK_LEN, SIZE, CR) < 0) {
+        return -1;
+    }
+    ret = 0;
+    for (n = 1; n <= NB + CR; n++) {
+        if (codec->enc_next(n, out) < 0) {
+            return -1;
+        }
+        if (memcmp(out, (n <= NB) ? block + (n - 1) * SIZE : ref.rline + (n - NB - 1) * SIZE, SIZE) != 0) {
+            printf("fragment %d differs\n", n);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+template <uint16_t NB, uint8_t SIZE, uint16_t TOL, uint16_t CR>
+static void bench_run(double loss, int trials, uint32_t seed)
+{
+    typedef FragCodec<NB, SIZE, TOL, CR> codec_t;
+    static codec_t codec;
+    static uint8_t block[codec_t::BLOCK_LEN];
+    static uint8_t frag[NB + CR][SIZE];
+    static uint8_t dec_buf[codec_t::DEC_LEN] __attribute__((aligned(FRAG_DEC_ALIGN)));
+    frag_dec_t decobj;
+    FragBuf<const uint8_t> owner(block);
+    uint64_t t_codec, t_c, t0;
+    uint32_t s, i;
+    int t, n, ok, ret_codec, ret_c;
+    bool keep[NB + CR];
+
+    s = seed;
+    for (i = 0; i < sizeof(block); i++) {
+        block[i] = rnd_next(&s);
+    }
+    if (codec.enc_init(static_cast<FragBuf<const uint8_t> &&>(owner)) < 0) {
+        printf("enc_init failed\n");
+        return;
+    }
+    if (bench_check(&codec, block) < 0) {
+        printf("%4d %3d %4d %4d: mismatch\n", NB, SIZE, TOL, CR);
+        return;
+    }
+    for (n = 1; n <= NB + CR; n++) {
+        codec.enc_next(n, frag[n - 1]);
+    }
+    owner = codec.enc_release();
+
+    ok = 0;
+    t_codec = 0;
+    t_c = 0;
+    for (t = 0; t < trials; t++) {
+        for (n = 0; n < NB + CR; n++) {
+            keep[n] = (rnd_unit(&s) >= loss);
+        }
+
+        memset(flash_buf, 0, sizeof(block));
+        t0 = now_ns();
+        codec.dec_init(flash_read, flash_write, 0);
+        ret_codec = FRAG_DEC_ONGOING;
+        for (n = 0; (n < NB + CR) && (ret_codec == FRAG_DEC_ONGOING); n++) {
+            if (keep[n]) {
+                ret_codec = codec.dec(n + 1, FragSpan<const uint8_t>(frag[n]));
+            }
+        }
+        t_codec += now_ns() - t0;
+        if ((ret_codec < 0) || (memcmp(flash_buf, block, sizeof(block)) != 0)) {
+            continue;
+        }
+
+        memset(flash_buf, 0, sizeof(block));
+        t0 = now_ns();
+        memset(&decobj, 0, sizeof(decobj));
+        decobj.cfg.dt = dec_buf;
+        decobj.cfg.maxlen = sizeof(dec_buf);
+        decobj.cfg.nb = NB;
+        decobj.cfg.size = SIZE;
+        decobj.cfg.tolerence = TOL;
+        decobj.cfg.frd_func = flash_read;
+        decobj.cfg.fwr_func = flash_write;
+        frag_dec_init(&decobj);
+        ret_c = FRAG_DEC_ONGOING;
+        for (n = 0; (n < NB + CR) && (ret_c == FRAG_DEC_ONGOING); n++) {
+            if (keep[n]) {
+                ret_c = frag_dec(&decobj, n + 1, frag[n], SIZE);
+            }
+        }
+        t_c += now_ns() - t0;
+        if ((ret_c == ret_codec) && (memcmp(flash_buf, block, sizeof(block)) == 0)) {
+            ok++;
+        }
+    }
+    printf("%4d %3d %4d %4d %7u %6u %6d %9.1f %9.1f\n", NB, SIZE, TOL, CR, codec_t::ROWS_LEN, codec_t::DEC_LEN,
+           ok, t_codec / 1e3 / trials, t_c / 1e3 / trials);
+}
+
+int main(int argc, char **argv)
+{
+    double loss;
+    uint32_t seed;
+    int i, trials;
+
+    loss = 0.1;
+    trials = 1000;
+    seed = 0x12345678;
+    for (i = 1; i + 1 < argc; i += 2) {
+        switch (argv[i][1]) {
+        case 'l': loss = atof(argv[i + 1]); break;
+        case 'i': trials = atoi(argv[i + 1]); break;
+        case 'r': seed = strtoul(argv[i + 1], NULL, 0); break;
+        default:
+            printf("usage: %s [-l loss] [-i trials] [-r seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if ((i < argc) || (trials <= 0)) {
+        printf("usage: %s [-l loss] [-i trials] [-r seed]\n", argv[0]);
+        return 1;
+    }
+
+    printf("  nb size  tol   cr     rom    ram     ok  codec us      c us\n");
+    bench_run<8, 24, 8, 15>(loss, trials, seed);
+    bench_run<64, 51, 24, 32>(loss, trials, seed);
+    bench_run<256, 51, 64, 96>(loss, trials, seed);
+    bench_run<1024, 51, 160, 256>(loss, trials / 10 + 1, seed);
+    return 0;
+}
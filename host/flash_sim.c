@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include "flash_sim.h"
+
+int flash_sim_init(flash_sim_t *sim, uint32_t page_size, uint32_t sector_size, uint32_t sectors)
+{
+    if ((page_size == 0) || (sector_size == 0) || ((sector_size % page_size) != 0) || (sectors == 0)) {
+        return -1;
+    }
+    memset(sim, 0, sizeof(*sim));
+    sim->page_size = page_size;
+    sim->sector_size = sector_size;
+    sim->sectors = sectors;
+    sim->t_prog_us = 700;
+    sim->t_erase_us = 45000;
+    sim->t_byte_ns = 160;
+    sim->mem = malloc((size_t)sector_size * sectors);
+    sim->erase_cnt = calloc(sectors, sizeof(uint32_t));
+    if ((sim->mem == NULL) || (sim->erase_cnt == NULL)) {
+        flash_sim_deinit(sim);
+        return -1;
+    }
+    memset(sim->mem, 0xFF, (size_t)sector_size * sectors);
+    return 0;
+}
+
+void flash_sim_deinit(flash_sim_t *sim)
+{
+    free(sim->mem);
+    free(sim->erase_cnt);
+    sim->mem = NULL;
+    sim->erase_cnt = NULL;
+}
+
+void flash_sim_reset_stats(flash_sim_t *sim)
+{
+    sim->rd_bytes = 0;
+    sim->prog_bytes = 0;
+    sim->prog_cnt = 0;
+    sim->erases = 0;
+    sim->errors = 0;
+    sim->busy_us = 0;
+}
+
+uint32_t flash_sim_max_erase(flash_sim_t *sim)
+{
+    uint32_t i, m;
+
+    m = 0;
+    for (i = 0; i < sim->sectors; i++) {
+        if (sim->erase_cnt[i] > m) {
+            m = sim->erase_cnt[i];
+        }
+    }
+    return m;
+}
+
+static int flash_sim_range(flash_sim_t *sim, uint32_t addr, uint32_t len)
+{
+    return ((uint64_t)addr + len <= (uint64_t)sim->sector_size * sim->sectors) ? 0 : -1;
+}
+
+int flash_sim_read(flash_sim_t *sim, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    if (flash_sim_range(sim, addr, len) != 0) {
+        sim->errors++;
+        return -1;
+    }
+    memcpy(buf, sim->mem + addr, len);
+    sim->rd_bytes += len;
+    sim->busy_us += (uint64_t)len * sim->t_byte_ns / 1000;
+    return 0;
+}
+
+int flash_sim_write(flash_sim_t *sim, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    uint32_t i;
+
+    if ((len == 0) || (flash_sim_range(sim, addr, len) != 0) ||
+        (addr / sim->page_size != (addr + len - 1) / sim->page_size)) {
+        sim->errors++;
+        return -1;
+    }
+    for (i = 0; i < len; i++) {
+        if ((buf[i] & ~sim->mem[addr + i]) != 0) {
+            /* would need an erase */
+            sim->errors++;
+            return -1;
+        }
+    }
+    for (i = 0; i < len; i++) {
+        sim->mem[addr + i] &= buf[i];
+    }
+    sim->prog_bytes += len;
+    sim->prog_cnt++;
+    sim->busy_us += sim->t_prog_us + (uint64_t)len * sim->t_byte_ns / 1000;
+    return 0;
+}
+
+int flash_sim_erase(flash_sim_t *sim, uint32_t addr)
+{
+    uint32_t s;
+
+    if (((addr % sim->sector_size) != 0) || (flash_sim_range(sim, addr, sim->sector_size) != 0)) {
+        sim->errors++;
+        return -1;
+    }
+    s = addr / sim->sector_size;
+    memset(sim->mem + addr, 0xFF, sim->sector_size);
+    sim->erase_cnt[s]++;
+    sim->erases++;
+    sim->busy_us += sim->t_erase_us;
+    return 0;
+}
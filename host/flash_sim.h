@@ -0,0 +1,45 @@
+#ifndef __FLASH_SIM_H
+#define __FLASH_SIM_H
+
+#include <stdint.h>
+
+/*
+ NOR flash simulator.
+
+ Erase sets a whole sector to 0xFF, a program can only clear bits and must
+ stay inside one page. A program that would set a bit, cross a page or
+ leave the device fails and is counted in errors, the memory is left
+ untouched. Busy time is estimated from the timing fields, defaults are
+ those of a common 4 KB sector SPI NOR.
+ */
+
+typedef struct {
+    uint32_t page_size;
+    uint32_t sector_size;
+    uint32_t sectors;
+    uint32_t t_prog_us;         // page program
+    uint32_t t_erase_us;        // sector erase
+    uint32_t t_byte_ns;         // bus time per byte read or written
+
+    uint8_t *mem;
+    uint32_t *erase_cnt;        // per sector
+
+    uint64_t rd_bytes;
+    uint64_t prog_bytes;
+    uint32_t prog_cnt;
+    uint32_t erases;
+    uint32_t errors;
+    uint64_t busy_us;
+} flash_sim_t;
+
+int flash_sim_init(flash_sim_t *sim, uint32_t page_size, uint32_t sector_size, uint32_t sectors);
+void flash_sim_deinit(flash_sim_t *sim);
+/* clear the counters, the content and the erase counts are kept */
+void flash_sim_reset_stats(flash_sim_t *sim);
+uint32_t flash_sim_max_erase(flash_sim_t *sim);
+
+int flash_sim_read(flash_sim_t *sim, uint32_t addr, uint8_t *buf, uint32_t len);
+int flash_sim_write(flash_sim_t *sim, uint32_t addr, uint8_t *buf, uint32_t len);
+int flash_sim_erase(flash_sim_t *sim, uint32_t addr);
+
+#endif // __FLASH_SIM_H
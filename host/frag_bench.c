@@ -0,0 +1,453 @@
+/*
+ Host-side benchmark for frag_enc / frag_dec.
+
+ Build (from the repository root):
+   gcc -O2 -pthread -I. -Ihost -o frag_bench host/frag_bench.c host/frag_enc_mt.c frag.c bitmap.c xorbuf.c
+
+ Usage:
+   frag_bench [-n nb,nb,...] [-s size,...] [-c coding_rate,...] [-l loss,...]
+              [-r seed] [-t threads] [-f cache_len] [-w window_len] [-b] [-k]
+
+ For every (nb, size, coding rate, loss) combination the data block is
+ encoded, sent through an i.i.d. lossy channel and decoded. Reported:
+   enc MB/s     data block bytes / time of one frag_enc call
+   dec p50/p99  per fragment frag_dec latency (us), last call excluded
+   recon        latency of the frag_dec call that finishes the block (us)
+   ram          bytes used in cfg.dt, as returned by frag_dec_init
+   f.rd f.wr    frd_func / fwr_func calls made by the decoder
+
+ -t encodes with frag_enc_mt on that many threads.
+ -b gives frag_enc no room for tiles, so coded rows are computed one at a
+ time. The coded fragments are always checked against that encoder.
+ -f gives the decoder a fragment cache of cache_len bytes (cfg.cache_len).
+ -w adds window_len bytes to cfg.dt for the reconstruction window.
+ -k shares a prefilled parity row cache between the encoder and decoder,
+ as a gateway serving many sessions of the same nb would.
+ Built with -DFRAG_STATS, every point gets a line with the counters of the
+ decoder: bytes xored, flash reads and writes (calls / bytes), matrix rows
+ loaded / saved, rows eliminated per coded frame (mean / max), redundant
+ frames and the time of the uncoded, coded and back substitution stages.
+
+ The default sweep goes up to nb = 8000 and takes a while, narrow it down
+ with the options above when only a few points are needed. Points where
+ nb + cr exceeds FRAG_N_MAX (16383, the 14-bit fragment number of the
+ frame header) are skipped.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "frag.h"
+#include "frag_enc_mt.h"
+
+#define BENCH_MAX_LIST          (16)
+#define BENCH_ENC_MIN_NS        (100000000ULL) // repeat encoding for at least 100ms
+#define BENCH_TOL_MARGIN        (0.05)
+
+typedef struct {
+    int nb[BENCH_MAX_LIST];
+    int nb_cnt;
+    int size[BENCH_MAX_LIST];
+    int size_cnt;
+    double cr[BENCH_MAX_LIST];
+    int cr_cnt;
+    double loss[BENCH_MAX_LIST];
+    int loss_cnt;
+    uint32_t seed;
+    int threads;
+    uint32_t cache_len;
+    uint32_t window_len;
+    bool rows;
+    bool rcache;
+} bench_cfg_t;
+
+typedef struct {
+    double enc_mbps;
+    double dec_p50_us;
+    double dec_p99_us;
+    double recon_us;
+    int ram;
+    int ret;
+    int sent;
+    int lost;
+    uint32_t flash_rd;
+    uint32_t flash_wr;
+#ifdef FRAG_STATS
+    frag_dec_stats_t st;
+#endif
+} bench_res_t;
+
+static uint8_t *flash_buf;
+static uint32_t flash_rd_cnt, flash_wr_cnt;
+
+static int flash_write(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    flash_wr_cnt++;
+    memcpy(flash_buf + addr, buf, len);
+    return 0;
+}
+
+static int flash_read(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    flash_rd_cnt++;
+    memcpy(buf, flash_buf + addr, len);
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* xorshift32, channel and data generator */
+static uint32_t rnd_next(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return x;
+}
+
+static double rnd_unit(uint32_t *s)
+{
+    return (rnd_next(s) >> 8) / (double)(1 << 24);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(uint64_t *v, int cnt, double p)
+{
+    int i;
+    if (cnt <= 0) {
+        return 0;
+    }
+    i = (int)(p * (cnt - 1) + 0.5);
+    return v[i] / 1000.0;
+}
+
+/* compare the coded fragments in encobj with the row by row frag_enc */
+static int bench_enc_check(frag_enc_t *encobj, uint8_t *buf, int len, int unit, int cr)
+{
+    frag_enc_t ref;
+    uint32_t maxlen;
+    int ret;
+
+    maxlen = len + cr * unit + FRAG_ENC_LINE_LEN(len / unit);
+    memset(&ref, 0, sizeof(ref));
+    ref.dt = malloc(maxlen);
+    ref.maxlen = maxlen;
+    if (ref.dt == NULL) {
+        return -1;
+    }
+    ret = frag_enc(&ref, buf, len, unit, cr);
+    if (ret == 0) {
+        ret = memcmp(ref.rline, encobj->rline, cr * unit);
+    }
+    free(ref.dt);
+    return ret;
+}
+
+/* the frag_dec_init layout */
+static int dec_buf_len(int nb, int size, int tol, uint32_t cache_len)
+{
+    frag_dec_cfg_t dcfg;
+
+    memset(&dcfg, 0, sizeof(dcfg));
+    dcfg.nb = nb;
+    dcfg.size = size;
+    dcfg.tolerence = tol;
+    dcfg.cache_len = cache_len;
+    return frag_dec_mem_size(&dcfg);
+}
+
+static int bench_one(bench_res_t *res, int nb, int size, double rate, double loss, bench_cfg_t *cfg)
+{
+    frag_enc_t encobj;
+    frag_dec_t decobj;
+    frag_row_cache_t rcache;
+    uint8_t *enc_buf, *dec_buf, *rc_buf;
+    uint32_t rc_len;
+    uint64_t *lat;
+    uint64_t t0, t1, total;
+    int cr, len, tol, i, loops, lat_cnt, ret;
+    uint32_t enc_len;
+    uint32_t s, seed;
+    bool use_rcache;
+
+    memset(res, 0, sizeof(*res));
+    seed = cfg->seed;
+    use_rcache = cfg->rcache;
+
+    cr = (int)(nb / rate + 0.5) - nb;
+    if (cr < 1) {
+        cr = 1;
+    }
+    if (nb + cr > FRAG_N_MAX) {
+        /* fragment numbers would not fit the 14 bits of the frame header */
+        return 1;
+    }
+    len = nb * size;
+    tol = 10 + (int)(nb * (loss + BENCH_TOL_MARGIN));
+    if (tol > nb) {
+        tol = nb;
+    }
+
+    enc_len = len + cr * size + (cfg->rows ? FRAG_ENC_LINE_LEN(nb) : FRAG_ENC_TILE_LEN(nb));
+    enc_buf = malloc(enc_len);
+    dec_buf = malloc(dec_buf_len(nb, size, tol, cfg->cache_len) + cfg->window_len);
+    flash_buf = malloc(nb * size);
+    lat = malloc(sizeof(uint64_t) * (nb + cr));
+    rc_len = FRAG_ROW_CACHE_LEN(nb, cr);
+    rc_buf = use_rcache ? malloc(rc_len) : NULL;
+    if (!enc_buf || !dec_buf || !flash_buf || !lat || (use_rcache && !rc_buf)) {
+        free(enc_buf);
+        free(dec_buf);
+        free(flash_buf);
+        free(lat);
+        free(rc_buf);
+        return -1;
+    }
+    if (use_rcache) {
+        frag_row_cache_init(&rcache, rc_buf, rc_len, nb, cr);
+        frag_row_cache_fill(&rcache);
+    }
+
+    s = seed;
+    for (i = 0; i < len; i++) {
+        enc_buf[i] = (uint8_t)rnd_next(&s);
+    }
+
+    /* encode */
+    memset(&encobj, 0, sizeof(encobj));
+    encobj.dt = enc_buf;
+    encobj.rcache = use_rcache ? &rcache : NULL;
+    encobj.maxlen = enc_len;
+    total = 0;
+    loops = 0;
+    do {
+        t0 = now_ns();
+        ret = frag_enc_mt(&encobj, enc_buf, len, size, cr, cfg->threads);
+        t1 = now_ns();
+        if (ret != 0) {
+            res->ret = ret;
+            goto out;
+        }
+        total += t1 - t0;
+        loops++;
+    } while (total < BENCH_ENC_MIN_NS);
+    res->enc_mbps = (double)len * loops / (total / 1e9) / 1e6;
+    if (bench_enc_check(&encobj, enc_buf, len, size, cr) != 0) {
+        res->ret = FRAG_DEC_ERR_2;
+        goto out;
+    }
+
+    /* decode */
+    memset(&decobj, 0, sizeof(decobj));
+    decobj.cfg.dt = dec_buf;
+    decobj.cfg.rcache = use_rcache ? &rcache : NULL;
+    decobj.cfg.cache_len = cfg->cache_len;
+    decobj.cfg.nb = nb;
+    decobj.cfg.size = size;
+    decobj.cfg.tolerence = tol;
+    decobj.cfg.maxlen = dec_buf_len(nb, size, tol, cfg->cache_len) + cfg->window_len;
+    decobj.cfg.frd_func = flash_read;
+    decobj.cfg.fwr_func = flash_write;
+    flash_rd_cnt = 0;
+    flash_wr_cnt = 0;
+    res->ram = frag_dec_init(&decobj);
+    if (res->ram < 0) {
+        res->ret = res->ram;
+        goto out;
+    }
+
+    s = seed ^ 0x5a5a5a5a;
+    lat_cnt = 0;
+    ret = FRAG_DEC_ONGOING;
+    for (i = 0; i < nb + cr; i++) {
+        res->sent++;
+        if (rnd_unit(&s) < loss) {
+            res->lost++;
+            continue;
+        }
+        t0 = now_ns();
+        ret = frag_dec(&decobj, i + 1, enc_buf + i * size, size);
+        t1 = now_ns();
+        if (ret == FRAG_DEC_ONGOING) {
+            lat[lat_cnt++] = t1 - t0;
+            continue;
+        }
+        res->recon_us = (t1 - t0) / 1000.0;
+        break;
+    }
+    res->ret = ret;
+    res->flash_rd = flash_rd_cnt;
+    res->flash_wr = flash_wr_cnt;
+#ifdef FRAG_STATS
+    res->st = decobj.stats;
+#endif
+    if ((ret >= 0) && (memcmp(flash_buf, enc_buf, len) != 0)) {
+        res->ret = FRAG_DEC_ERR_2;
+    }
+
+    qsort(lat, lat_cnt, sizeof(uint64_t), cmp_u64);
+    res->dec_p50_us = percentile_us(lat, lat_cnt, 0.50);
+    res->dec_p99_us = percentile_us(lat, lat_cnt, 0.99);
+
+out:
+    free(enc_buf);
+    free(dec_buf);
+    free(flash_buf);
+    free(lat);
+    free(rc_buf);
+    return 0;
+}
+
+static int parse_ints(const char *arg, int *out)
+{
+    int cnt = 0;
+    char *end;
+    while (*arg && cnt < BENCH_MAX_LIST) {
+        out[cnt++] = (int)strtol(arg, &end, 10);
+        if (*end != ',') {
+            break;
+        }
+        arg = end + 1;
+    }
+    return cnt;
+}
+
+static int parse_doubles(const char *arg, double *out)
+{
+    int cnt = 0;
+    char *end;
+    while (*arg && cnt < BENCH_MAX_LIST) {
+        out[cnt++] = strtod(arg, &end);
+        if (*end != ',') {
+            break;
+        }
+        arg = end + 1;
+    }
+    return cnt;
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [-n nb,...] [-s size,...] [-c coding_rate,...] [-l loss,...] [-r seed] [-t threads] [-f cache_len] [-w window_len] [-b] [-k]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    static const int def_nb[] = {10, 128, 1024, 4096, 8000};
+    static const int def_size[] = {10, 51, 242};
+    static const double def_cr[] = {0.8, 0.5};
+    static const double def_loss[] = {0.05, 0.2};
+    bench_cfg_t cfg;
+    bench_res_t res;
+    int a, b, c, d, i, ret;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.nb_cnt = sizeof(def_nb) / sizeof(def_nb[0]);
+    memcpy(cfg.nb, def_nb, sizeof(def_nb));
+    cfg.size_cnt = sizeof(def_size) / sizeof(def_size[0]);
+    memcpy(cfg.size, def_size, sizeof(def_size));
+    cfg.cr_cnt = sizeof(def_cr) / sizeof(def_cr[0]);
+    memcpy(cfg.cr, def_cr, sizeof(def_cr));
+    cfg.loss_cnt = sizeof(def_loss) / sizeof(def_loss[0]);
+    memcpy(cfg.loss, def_loss, sizeof(def_loss));
+    cfg.seed = 0x12345678;
+    cfg.threads = 1;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-k") == 0) {
+            cfg.rcache = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-b") == 0) {
+            cfg.rows = true;
+            continue;
+        }
+        if ((argv[i][0] != '-') || (i + 1 >= argc)) {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+        case 'n':
+            cfg.nb_cnt = parse_ints(argv[++i], cfg.nb);
+            break;
+        case 's':
+            cfg.size_cnt = parse_ints(argv[++i], cfg.size);
+            break;
+        case 'c':
+            cfg.cr_cnt = parse_doubles(argv[++i], cfg.cr);
+            break;
+        case 'l':
+            cfg.loss_cnt = parse_doubles(argv[++i], cfg.loss);
+            break;
+        case 'r':
+            cfg.seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+            break;
+        case 't':
+            cfg.threads = atoi(argv[++i]);
+            break;
+        case 'f':
+            cfg.cache_len = strtoul(argv[++i], NULL, 0);
+            break;
+        case 'w':
+            cfg.window_len = strtoul(argv[++i], NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%6s %4s %5s %5s | %9s | %9s %9s %11s | %9s %8s %7s | %6s %5s %s\n",
+           "nb", "size", "cr", "loss", "enc MB/s", "dec p50", "dec p99", "recon us", "ram", "f.rd", "f.wr",
+           "sent", "lost", "result");
+    for (a = 0; a < cfg.nb_cnt; a++) {
+        for (b = 0; b < cfg.size_cnt; b++) {
+            for (c = 0; c < cfg.cr_cnt; c++) {
+                for (d = 0; d < cfg.loss_cnt; d++) {
+                    ret = bench_one(&res, cfg.nb[a], cfg.size[b], cfg.cr[c], cfg.loss[d], &cfg);
+                    if (ret != 0) {
+                        printf("%6d %4d %5.2f %5.2f | %s\n", cfg.nb[a], cfg.size[b], cfg.cr[c], cfg.loss[d],
+                               (ret > 0) ? "more than FRAG_N_MAX fragments" : "out of memory");
+                        continue;
+                    }
+                    printf("%6d %4d %5.2f %5.2f | %9.2f | %9.2f %9.2f %11.1f | %9d %8u %7u | %6d %5d %s",
+                           cfg.nb[a], cfg.size[b], cfg.cr[c], cfg.loss[d],
+                           res.enc_mbps, res.dec_p50_us, res.dec_p99_us, res.recon_us,
+                           res.ram, res.flash_rd, res.flash_wr, res.sent, res.lost,
+                           (res.ret >= 0) ? "ok" : "fail");
+                    if (res.ret < 0) {
+                        printf(" (%d)", res.ret);
+                    }
+                    printf("\n");
+#ifdef FRAG_STATS
+                    printf("%21s | xor %.1f kB, rd %u / %.1f kB, wr %u / %.1f kB, rows %u / %u, elim %.1f / %u per frame, "
+                           "redundant %u, us %.1f / %.1f / %.1f\n", "stats",
+                           res.st.xor_bytes / 1e3, res.st.frd_calls, res.st.frd_bytes / 1e3,
+                           res.st.fwr_calls, res.st.fwr_bytes / 1e3, res.st.row_loads, res.st.row_saves,
+                           res.st.coded_frames ? (double)res.st.elim_steps / res.st.coded_frames : 0.0,
+                           res.st.elim_max, res.st.redundant,
+                           res.st.cyc_uncoded / 1e3, res.st.cyc_coded / 1e3, res.st.cyc_recon / 1e3);
+#endif
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "frag_enc_mt.h"
+
+typedef struct {
+    frag_enc_t enc;             // private copy, own mline
+    uint32_t first;             // coded rows [first, last)
+    uint32_t last;
+    pthread_t thread;
+    bool started;
+} frag_enc_job_t;
+
+static void *frag_enc_worker(void *arg)
+{
+    frag_enc_job_t *job = arg;
+
+    frag_enc_rows(&job->enc, job->first, job->last);
+    return NULL;
+}
+
+int frag_enc_mt(frag_enc_t *obj, uint8_t *buf, int len, int unit, int cr, int threads)
+{
+    frag_enc_job_t *job;
+    uint8_t *scratch;
+    uint32_t line_len, step, parts;
+    int t, ret;
+
+    if (threads <= 1 || cr < 2) {
+        return frag_enc(obj, buf, len, unit, cr);
+    }
+
+    /* obj is laid out as frag_enc does, the jobs write its coded rows */
+    ret = frag_enc_layout(obj, buf, len, unit, cr);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* with room for tiles in obj->dt, every job tiles too and gets whole tiles */
+    if (ret > 0) {
+        line_len = FRAG_ENC_TILE_LEN(obj->num);
+        step = FRAG_ENC_TILE_ROWS;
+    } else {
+        line_len = FRAG_ENC_LINE_LEN(obj->num);
+        step = 1;
+    }
+    parts = (cr + step - 1) / step;
+    /* the jobs share the row cache, filling it lazily would race on valid_bm */
+    if ((obj->rcache != NULL) && (obj->rcache->nb == obj->num)) {
+        frag_row_cache_fill(obj->rcache);
+    }
+    if ((uint32_t)threads > parts) {
+        threads = parts;
+    }
+
+    job = calloc(threads, sizeof(frag_enc_job_t));
+    scratch = malloc((size_t)threads * line_len);
+    if ((job == NULL) || (scratch == NULL)) {
+        free(job);
+        free(scratch);
+        return -3;
+    }
+
+    for (t = 0; t < threads; t++) {
+        job[t].enc.dt = scratch + (size_t)t * line_len;
+        job[t].enc.maxlen = line_len;
+        job[t].enc.rcache = obj->rcache;
+        ret = frag_enc_init(&job[t].enc, buf, len, unit);
+        if (ret < 0) {
+            free(job);
+            free(scratch);
+            return ret;
+        }
+        job[t].enc.rline = obj->rline;
+        job[t].first = (uint32_t)((uint64_t)parts * t / threads) * step;
+        job[t].last = (uint32_t)((uint64_t)parts * (t + 1) / threads) * step;
+        if (job[t].last > (uint32_t)cr) {
+            job[t].last = cr;
+        }
+    }
+
+    for (t = 1; t < threads; t++) {
+        job[t].started = (pthread_create(&job[t].thread, NULL, frag_enc_worker, &job[t]) == 0);
+    }
+    /* the caller thread takes the first range, and any range whose thread didn't start */
+    frag_enc_worker(&job[0]);
+    for (t = 1; t < threads; t++) {
+        if (job[t].started) {
+            pthread_join(job[t].thread, NULL);
+        } else {
+            frag_enc_worker(&job[t]);
+        }
+    }
+
+#ifdef FRAG_STATS
+    /* cycles are summed over the threads */
+    for (t = 0; t < threads; t++) {
+        obj->stats.xor_bytes += job[t].enc.stats.xor_bytes;
+        obj->stats.rows += job[t].enc.stats.rows;
+        obj->stats.rows_gen += job[t].enc.stats.rows_gen;
+        obj->stats.cyc += job[t].enc.stats.cyc;
+    }
+#endif
+    free(job);
+    free(scratch);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef __FRAG_ENC_MT_H
+#define __FRAG_ENC_MT_H
+
+#include "frag.h"
+
+/*
+ Same contract and output as frag_enc, the cr coded rows are split in
+ contiguous ranges over threads, whole FRAG_ENC_TILE_ROWS tiles when
+ obj->dt has room for the tiled encoder. Every thread produces its rows
+ with frag_enc_rows on a private copy of obj and its own matrix line
+ scratch, so the result is byte identical to the serial encoder.
+ obj->rcache is shared by the threads: a cache of this nb is filled
+ (frag_row_cache_fill) before they start, so they only read it. Under
+ FRAG_STATS the counters of the threads are added into obj->stats, cycles
+ summed over them.
+ */
+int frag_enc_mt(frag_enc_t *obj, uint8_t *buf, int len, int unit, int cr, int threads);
+
+#endif // __FRAG_ENC_MT_H
@@ -0,0 +1,581 @@
+/*
+ Monte Carlo channel simulator for frag_enc / frag_dec.
+
+ Build (from the repository root):
+   gcc -O2 -pthread -I. -Ihost -o frag_mc host/frag_mc.c frag.c bitmap.c xorbuf.c -lm
+
+ Usage:
+   frag_mc [-n nb,...] [-c coding_rate,...] [-l loss,...] [-s size] [-i trials]
+           [-t threads] [-r seed] [-m iid|ge|trace] [-b burst] [-e good,bad] [-f trace_file]
+
+ For every (nb, coding rate, loss) point the block is encoded once, then
+ each trial sends the nb + cr fragments through the channel and decodes
+ them until frag_dec finishes, as a receiver would. Trials are spread over
+ the threads, each with its own decoder, flash and random stream.
+
+ Channels:
+   iid     every frame is lost with probability loss
+   ge      Gilbert-Elliott: frames are lost with probability good / bad
+           (-e, default 0,1) in each state, the bad state lasts burst
+           frames on average (-b) and the mean loss is loss
+   trace   -f file of '1' (received) and '0' (lost) characters, anything
+           else is skipped; every trial starts at a random offset and wraps
+           around, -l is replaced by the loss of the trace
+
+ Reported:
+   success      decoded sessions / trials, with the 95% interval
+   ovh avg p99  frames received beyond nb when decoding finished
+   dec ms       decoding time of one session
+   fail         sessions that ran out of frames
+
+ The decoder tolerance is min(nb, cr): a lower one only adds failures, see
+ frag_rate_tolerence for sizing it against memory. Points where nb + cr
+ exceeds FRAG_N_MAX (16383, the 14-bit fragment number of the frame
+ header) are skipped.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "frag.h"
+
+#define MC_MAX_LIST             (16)
+#define MC_MAX_THREADS          (256)
+
+typedef enum {
+    MC_IID,
+    MC_GE,
+    MC_TRACE,
+} mc_model_t;
+
+typedef struct {
+    int nb[MC_MAX_LIST];
+    int nb_cnt;
+    double cr[MC_MAX_LIST];
+    int cr_cnt;
+    double loss[MC_MAX_LIST];
+    int loss_cnt;
+    int size;
+    uint32_t trials;
+    int threads;
+    uint32_t seed;
+    mc_model_t model;
+    double burst;
+    double e_good;
+    double e_bad;
+    uint8_t *trace;             // 1 received, 0 lost
+    uint32_t trace_len;
+} mc_cfg_t;
+
+/* one point of the sweep, read only while the trials run */
+typedef struct {
+    mc_cfg_t *cfg;
+    int nb;
+    int cr;
+    int tol;
+    double loss;
+    double p_gb;                // ge transitions
+    double p_bg;
+    uint8_t *block;             // nb uncoded then cr coded fragments
+} mc_point_t;
+
+typedef struct {
+    mc_point_t *pt;
+    uint32_t trials;
+    uint32_t seed;
+    pthread_t thread;
+    bool started;
+    int ret;
+
+    uint32_t ok;
+    uint32_t corrupt;
+    uint32_t fail;
+    uint64_t ovh_sum;
+    uint32_t *ovh_hist;         // cr + 1 bins
+    uint64_t dec_ns;
+} mc_job_t;
+
+static __thread uint8_t *flash_buf;
+
+static int flash_write(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    memcpy(flash_buf + addr, buf, len);
+    return 0;
+}
+
+static int flash_read(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    memcpy(buf, flash_buf + addr, len);
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* xorshift32, seeded through splitmix so that streams of nearby seeds differ */
+static uint32_t rnd_seed(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return ((uint32_t)x != 0) ? (uint32_t)x : 1;
+}
+
+static uint32_t rnd_next(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return x;
+}
+
+static double rnd_unit(uint32_t *s)
+{
+    return (rnd_next(s) >> 8) / (double)(1 << 24);
+}
+
+/* channel state of one trial */
+typedef struct {
+    bool bad;
+    uint32_t pos;
+} mc_chan_t;
+
+static void mc_chan_init(mc_point_t *pt, mc_chan_t *ch, uint32_t *s)
+{
+    mc_cfg_t *cfg = pt->cfg;
+
+    ch->bad = false;
+    ch->pos = 0;
+    if (cfg->model == MC_GE) {
+        /* start from the stationary distribution */
+        ch->bad = rnd_unit(s) < pt->p_gb / (pt->p_gb + pt->p_bg);
+    } else if (cfg->model == MC_TRACE) {
+        ch->pos = rnd_next(s) % cfg->trace_len;
+    }
+}
+
+static bool mc_chan_lost(mc_point_t *pt, mc_chan_t *ch, uint32_t *s)
+{
+    mc_cfg_t *cfg = pt->cfg;
+    bool lost;
+
+    switch (cfg->model) {
+    case MC_GE:
+        lost = rnd_unit(s) < (ch->bad ? cfg->e_bad : cfg->e_good);
+        ch->bad = rnd_unit(s) < (ch->bad ? 1 - pt->p_bg : pt->p_gb);
+        return lost;
+    case MC_TRACE:
+        lost = cfg->trace[ch->pos] == 0;
+        if (++ch->pos == cfg->trace_len) {
+            ch->pos = 0;
+        }
+        return lost;
+    default:
+        return rnd_unit(s) < pt->loss;
+    }
+}
+
+static void *mc_worker(void *arg)
+{
+    mc_job_t *job = arg;
+    mc_point_t *pt = job->pt;
+    frag_dec_t dec;
+    frag_dec_cfg_t dcfg;
+    mc_chan_t ch;
+    uint8_t *dec_buf;
+    uint32_t len, t, s;
+    uint64_t t0;
+    int i, ret, rx, size;
+
+    size = pt->cfg->size;
+    memset(&dcfg, 0, sizeof(dcfg));
+    dcfg.nb = pt->nb;
+    dcfg.size = size;
+    dcfg.tolerence = pt->tol;
+    /* room for a back substitution window of every lost fragment */
+    len = frag_dec_mem_size(&dcfg) + pt->tol * FRAG_DEC_ROW_LEN(size);
+    dec_buf = malloc(len);
+    flash_buf = malloc((size_t)pt->nb * size);
+    if ((dec_buf == NULL) || (flash_buf == NULL)) {
+        job->ret = -1;
+        goto out;
+    }
+
+    s = job->seed;
+    for (t = 0; t < job->trials; t++) {
+        memset(&dec, 0, sizeof(dec));
+        dec.cfg = dcfg;
+        dec.cfg.dt = dec_buf;
+        dec.cfg.maxlen = len;
+        dec.cfg.frd_func = flash_read;
+        dec.cfg.fwr_func = flash_write;
+        mc_chan_init(pt, &ch, &s);
+
+        t0 = now_ns();
+        if (frag_dec_init(&dec) < 0) {
+            job->ret = -1;
+            goto out;
+        }
+        ret = FRAG_DEC_ONGOING;
+        rx = 0;
+        for (i = 0; i < pt->nb + pt->cr; i++) {
+            if (mc_chan_lost(pt, &ch, &s)) {
+                continue;
+            }
+            rx++;
+            ret = frag_dec(&dec, i + 1, pt->block + i * size, size);
+            if (ret != FRAG_DEC_ONGOING) {
+                break;
+            }
+        }
+        job->dec_ns += now_ns() - t0;
+
+        if (ret < 0) {
+            job->fail++;
+            continue;
+        }
+        if (memcmp(flash_buf, pt->block, (size_t)pt->nb * size) != 0) {
+            job->corrupt++;
+            continue;
+        }
+        job->ok++;
+        job->ovh_sum += rx - pt->nb;
+        job->ovh_hist[rx - pt->nb]++;
+    }
+
+out:
+    free(dec_buf);
+    free(flash_buf);
+    return NULL;
+}
+
+static int mc_point(mc_cfg_t *cfg, int nb, double rate, double loss, uint32_t index)
+{
+    frag_enc_t enc;
+    mc_point_t pt;
+    mc_job_t *job;
+    uint8_t *enc_buf;
+    uint32_t enc_len, i, s, ok, corrupt, fail, *hist, acc, p99;
+    uint64_t ovh_sum, dec_ns;
+    double p, half, pi_b;
+    int t, threads, ret;
+
+    memset(&pt, 0, sizeof(pt));
+    pt.cfg = cfg;
+    pt.nb = nb;
+    pt.cr = (int)(nb / rate + 0.5) - nb;
+    if (pt.cr < 1) {
+        pt.cr = 1;
+    }
+    if (nb + pt.cr > FRAG_N_MAX) {
+        /* fragment numbers would not fit the 14 bits of the frame header */
+        return 1;
+    }
+    pt.tol = (pt.cr < nb) ? pt.cr : nb;
+    pt.loss = loss;
+    if (cfg->model == MC_GE) {
+        pi_b = (loss - cfg->e_good) / (cfg->e_bad - cfg->e_good);
+        if ((pi_b < 0) || (pi_b >= 1)) {
+            printf("%6d %5.2f %6.3f | loss out of the range of -e\n", nb, rate, loss);
+            return 0;
+        }
+        pt.p_bg = 1 / cfg->burst;
+        pt.p_gb = pi_b * pt.p_bg / (1 - pi_b);
+    }
+
+    /* encode once, the frames of every trial come from this block */
+    enc_len = nb * cfg->size + pt.cr * cfg->size + FRAG_ENC_TILE_LEN(nb);
+    enc_buf = malloc(enc_len);
+    if (enc_buf == NULL) {
+        return -1;
+    }
+    s = rnd_seed(cfg->seed ^ ((uint64_t)index << 32));
+    for (i = 0; i < (uint32_t)nb * cfg->size; i++) {
+        enc_buf[i] = (uint8_t)rnd_next(&s);
+    }
+    memset(&enc, 0, sizeof(enc));
+    enc.dt = enc_buf;
+    enc.maxlen = enc_len;
+    if (frag_enc(&enc, enc_buf, nb * cfg->size, cfg->size, pt.cr) != 0) {
+        free(enc_buf);
+        return -1;
+    }
+    /* frag_enc puts the coded fragments right after the block */
+    pt.block = enc_buf;
+
+    threads = cfg->threads;
+    if ((uint32_t)threads > cfg->trials) {
+        threads = cfg->trials;
+    }
+    job = calloc(threads, sizeof(mc_job_t));
+    hist = calloc((size_t)threads * (pt.cr + 1), sizeof(uint32_t));
+    if ((job == NULL) || (hist == NULL)) {
+        free(job);
+        free(hist);
+        free(enc_buf);
+        return -1;
+    }
+    for (t = 0; t < threads; t++) {
+        job[t].pt = &pt;
+        job[t].trials = cfg->trials / threads + ((uint32_t)t < cfg->trials % threads);
+        job[t].seed = rnd_seed(((uint64_t)cfg->seed << 32) ^ ((uint64_t)index << 16) ^ t);
+        job[t].ovh_hist = hist + (size_t)t * (pt.cr + 1);
+        job[t].started = pthread_create(&job[t].thread, NULL, mc_worker, &job[t]) == 0;
+        if (!job[t].started) {
+            mc_worker(&job[t]);
+        }
+    }
+
+    ok = corrupt = fail = 0;
+    ovh_sum = dec_ns = 0;
+    ret = 0;
+    for (t = 0; t < threads; t++) {
+        if (job[t].started) {
+            pthread_join(job[t].thread, NULL);
+        }
+        if (job[t].ret != 0) {
+            ret = -1;
+        }
+        ok += job[t].ok;
+        corrupt += job[t].corrupt;
+        fail += job[t].fail;
+        ovh_sum += job[t].ovh_sum;
+        dec_ns += job[t].dec_ns;
+        if (t > 0) {
+            for (i = 0; i <= (uint32_t)pt.cr; i++) {
+                hist[i] += job[t].ovh_hist[i];
+            }
+        }
+    }
+
+    if (ret == 0) {
+        acc = 0;
+        for (p99 = 0; p99 < (uint32_t)pt.cr; p99++) {
+            acc += hist[p99];
+            if (acc >= 0.99 * ok) {
+                break;
+            }
+        }
+        /* Wilson interval */
+        p = (double)ok / cfg->trials;
+        half = 1.96 * sqrt(p * (1 - p) / cfg->trials + 1.96 * 1.96 / (4.0 * cfg->trials * cfg->trials)) /
+               (1 + 1.96 * 1.96 / cfg->trials);
+        printf("%6d %4d %5.2f %6.3f | %9u | %8.5f %8.5f | %7.2f %4u | %8.3f | %8u %7u\n",
+               nb, pt.cr, rate, loss, cfg->trials, p, half,
+               ok ? (double)ovh_sum / ok : 0.0, ok ? p99 : 0,
+               dec_ns / 1e6 / cfg->trials, fail, corrupt);
+        fflush(stdout);
+    }
+
+    free(job);
+    free(hist);
+    free(enc_buf);
+    return ret;
+}
+
+static int mc_load_trace(mc_cfg_t *cfg, const char *name)
+{
+    FILE *f;
+    uint32_t cap, lost;
+    int c;
+
+    f = fopen(name, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    cap = 4096;
+    cfg->trace = malloc(cap);
+    cfg->trace_len = 0;
+    lost = 0;
+    while ((cfg->trace != NULL) && ((c = fgetc(f)) != EOF)) {
+        if ((c != '0') && (c != '1')) {
+            continue;
+        }
+        if (cfg->trace_len == cap) {
+            cap *= 2;
+            cfg->trace = realloc(cfg->trace, cap);
+            if (cfg->trace == NULL) {
+                break;
+            }
+        }
+        cfg->trace[cfg->trace_len++] = c - '0';
+        lost += c == '0';
+    }
+    fclose(f);
+    if ((cfg->trace == NULL) || (cfg->trace_len == 0)) {
+        return -1;
+    }
+    /* a single point at the loss of the trace */
+    cfg->loss[0] = (double)lost / cfg->trace_len;
+    cfg->loss_cnt = 1;
+    return 0;
+}
+
+static int parse_ints(const char *arg, int *out)
+{
+    int cnt = 0;
+    char *end;
+    while (*arg && cnt < MC_MAX_LIST) {
+        out[cnt++] = (int)strtol(arg, &end, 10);
+        if (*end != ',') {
+            break;
+        }
+        arg = end + 1;
+    }
+    return cnt;
+}
+
+static int parse_doubles(const char *arg, double *out)
+{
+    int cnt = 0;
+    char *end;
+    while (*arg && cnt < MC_MAX_LIST) {
+        out[cnt++] = strtod(arg, &end);
+        if (*end != ',') {
+            break;
+        }
+        arg = end + 1;
+    }
+    return cnt;
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [-n nb,...] [-c coding_rate,...] [-l loss,...] [-s size] [-i trials] [-t threads] [-r seed] "
+           "[-m iid|ge|trace] [-b burst] [-e good,bad] [-f trace_file]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    static const int def_nb[] = {16, 64, 256};
+    static const double def_cr[] = {0.8, 0.67, 0.5};
+    static const double def_loss[] = {0.05, 0.1, 0.2, 0.3};
+    mc_cfg_t cfg;
+    const char *trace_name;
+    double e[2];
+    long n;
+    int a, b, c, i, ret;
+    uint32_t index;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.nb_cnt = sizeof(def_nb) / sizeof(def_nb[0]);
+    memcpy(cfg.nb, def_nb, sizeof(def_nb));
+    cfg.cr_cnt = sizeof(def_cr) / sizeof(def_cr[0]);
+    memcpy(cfg.cr, def_cr, sizeof(def_cr));
+    cfg.loss_cnt = sizeof(def_loss) / sizeof(def_loss[0]);
+    memcpy(cfg.loss, def_loss, sizeof(def_loss));
+    cfg.size = 10;
+    cfg.trials = 10000;
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    cfg.threads = (n > 0) ? n : 1;
+    cfg.seed = 0x12345678;
+    cfg.model = MC_IID;
+    cfg.burst = 4;
+    cfg.e_good = 0;
+    cfg.e_bad = 1;
+    trace_name = NULL;
+
+    for (i = 1; i < argc; i++) {
+        if ((argv[i][0] != '-') || (i + 1 >= argc)) {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+        case 'n':
+            cfg.nb_cnt = parse_ints(argv[++i], cfg.nb);
+            break;
+        case 'c':
+            cfg.cr_cnt = parse_doubles(argv[++i], cfg.cr);
+            break;
+        case 'l':
+            cfg.loss_cnt = parse_doubles(argv[++i], cfg.loss);
+            break;
+        case 's':
+            cfg.size = atoi(argv[++i]);
+            break;
+        case 'i':
+            cfg.trials = strtoul(argv[++i], NULL, 0);
+            break;
+        case 't':
+            cfg.threads = atoi(argv[++i]);
+            break;
+        case 'r':
+            cfg.seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+            break;
+        case 'm':
+            i++;
+            if (strcmp(argv[i], "iid") == 0) {
+                cfg.model = MC_IID;
+            } else if (strcmp(argv[i], "ge") == 0) {
+                cfg.model = MC_GE;
+            } else if (strcmp(argv[i], "trace") == 0) {
+                cfg.model = MC_TRACE;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'b':
+            cfg.burst = strtod(argv[++i], NULL);
+            break;
+        case 'e':
+            if (parse_doubles(argv[++i], e) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+            cfg.e_good = e[0];
+            cfg.e_bad = e[1];
+            break;
+        case 'f':
+            trace_name = argv[++i];
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((cfg.size < 1) || (cfg.size > 255) || (cfg.trials == 0) || (cfg.threads < 1) || (cfg.burst < 1) ||
+        (cfg.e_bad <= cfg.e_good)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (cfg.threads > MC_MAX_THREADS) {
+        cfg.threads = MC_MAX_THREADS;
+    }
+    if (cfg.model == MC_TRACE) {
+        if ((trace_name == NULL) || (mc_load_trace(&cfg, trace_name) != 0)) {
+            printf("cannot read a trace from %s\n", trace_name ? trace_name : "(none, use -f)");
+            return 1;
+        }
+    }
+
+    printf("%6s %4s %5s %6s | %9s | %8s %8s | %7s %4s | %8s | %8s %7s\n",
+           "nb", "cr", "rate", "loss", "trials", "success", "+-95%", "ovh avg", "p99", "dec ms", "fail", "corrupt");
+    index = 0;
+    for (a = 0; a < cfg.nb_cnt; a++) {
+        for (b = 0; b < cfg.cr_cnt; b++) {
+            for (c = 0; c < cfg.loss_cnt; c++) {
+                ret = mc_point(&cfg, cfg.nb[a], cfg.cr[b], cfg.loss[c], index++);
+                if (ret != 0) {
+                    printf("%6d %4s %5.2f %6.3f | %s\n", cfg.nb[a], "", cfg.cr[b], cfg.loss[c],
+                           (ret > 0) ? "more than FRAG_N_MAX fragments" : "out of memory");
+                }
+            }
+        }
+    }
+
+    free(cfg.trace);
+    return 0;
+}
@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frag_sess.h"
+
+#define SESS_ALIGN                  (64) // cache line, keeps sessions of different workers apart
+#define SESS_ALIGN_UP(x)            (((x) + SESS_ALIGN - 1) & ~(SESS_ALIGN - 1))
+
+#define SESS_MSG_FRAME              (0)
+#define SESS_MSG_CLOSE              (1)
+
+typedef struct {
+    uint32_t devaddr;
+    uint16_t fcnt;
+    uint8_t sess;
+    uint8_t type;
+} frag_sess_msg_t;
+
+/* fragment storage of all sessions, see frag_sess.h */
+static uint8_t *sess_store;
+
+static int sess_flash_wr(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    memcpy(sess_store + addr, buf, len);
+    return 0;
+}
+
+static int sess_flash_rd(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    memcpy(buf, sess_store + addr, len);
+    return 0;
+}
+
+static uint32_t sess_hash(uint32_t devaddr, uint8_t sess)
+{
+    uint32_t h;
+
+    h = devaddr ^ ((uint32_t)sess * 0x9e3779b1);
+    h ^= h >> 16;
+    h *= 0x7feb352d;
+    h ^= h >> 15;
+    h *= 0x846ca68b;
+    h ^= h >> 16;
+    return h;
+}
+
+static frag_sess_shard_t *sess_shard(frag_sess_mgr_t *mgr, uint32_t devaddr, uint8_t sess)
+{
+    uint32_t h = sess_hash(devaddr, sess);
+    /* high bits pick the worker, low bits the table slot */
+    return &mgr->shard[((uint64_t)h * mgr->cfg.workers) >> 32];
+}
+
+static int32_t table_find(frag_sess_shard_t *sh, uint32_t devaddr, uint8_t sess)
+{
+    uint32_t i;
+    int32_t s;
+
+    i = sess_hash(devaddr, sess) & sh->table_mask;
+    while ((s = sh->table[i]) >= 0) {
+        if ((sh->sess[s].devaddr == devaddr) && (sh->sess[s].sess == sess)) {
+            return s;
+        }
+        i = (i + 1) & sh->table_mask;
+    }
+    return -1;
+}
+
+static void table_ins(frag_sess_shard_t *sh, int32_t s)
+{
+    uint32_t i;
+
+    i = sess_hash(sh->sess[s].devaddr, sh->sess[s].sess) & sh->table_mask;
+    while (sh->table[i] >= 0) {
+        i = (i + 1) & sh->table_mask;
+    }
+    sh->table[i] = s;
+}
+
+/* linear probing delete with backward shift, no tombstones */
+static void table_del(frag_sess_shard_t *sh, int32_t s)
+{
+    uint32_t i, j, k;
+
+    i = sess_hash(sh->sess[s].devaddr, sh->sess[s].sess) & sh->table_mask;
+    while (sh->table[i] != s) {
+        i = (i + 1) & sh->table_mask;
+    }
+    j = i;
+    while (1) {
+        j = (j + 1) & sh->table_mask;
+        if (sh->table[j] < 0) {
+            break;
+        }
+        k = sess_hash(sh->sess[sh->table[j]].devaddr, sh->sess[sh->table[j]].sess) & sh->table_mask;
+        /* entry at j may stay if its home k is cyclically in (i, j] */
+        if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j))) {
+            continue;
+        }
+        sh->table[i] = sh->table[j];
+        i = j;
+    }
+    sh->table[i] = -1;
+}
+
+static void done_unlink(frag_sess_shard_t *sh, int32_t s)
+{
+    frag_sess_t *p = &sh->sess[s];
+
+    if (p->prev >= 0) {
+        sh->sess[p->prev].next = p->next;
+    } else {
+        sh->done_head = p->next;
+    }
+    if (p->next >= 0) {
+        sh->sess[p->next].prev = p->prev;
+    } else {
+        sh->done_tail = p->prev;
+    }
+}
+
+static void done_push(frag_sess_shard_t *sh, int32_t s)
+{
+    sh->sess[s].prev = sh->done_tail;
+    sh->sess[s].next = -1;
+    if (sh->done_tail >= 0) {
+        sh->sess[sh->done_tail].next = s;
+    } else {
+        sh->done_head = s;
+    }
+    sh->done_tail = s;
+}
+
+static void sess_release(frag_sess_shard_t *sh, int32_t s)
+{
+    if (sh->sess[s].sta == FRAG_SESS_STA_DONE) {
+        done_unlink(sh, s);
+    }
+    table_del(sh, s);
+    sh->sess[s].sta = FRAG_SESS_STA_FREE;
+    sh->sess[s].next = sh->free_head;
+    sh->free_head = s;
+}
+
+/* free slot first, otherwise the oldest finished session */
+static int32_t sess_alloc(frag_sess_shard_t *sh)
+{
+    int32_t s;
+
+    if (sh->free_head >= 0) {
+        s = sh->free_head;
+        sh->free_head = sh->sess[s].next;
+        return s;
+    }
+    if (sh->done_head >= 0) {
+        s = sh->done_head;
+        sess_release(sh, s);
+        sh->free_head = sh->sess[s].next;
+        sh->stats.sess_recycled++;
+        return s;
+    }
+    return -1;
+}
+
+static int32_t sess_open(frag_sess_mgr_t *mgr, frag_sess_shard_t *sh, uint32_t devaddr, uint8_t sess)
+{
+    int32_t s;
+    uint32_t g;
+    frag_sess_t *p;
+
+    s = sess_alloc(sh);
+    if (s < 0) {
+        return -1;
+    }
+    g = sh->base + s;
+    p = &sh->sess[s];
+    p->devaddr = devaddr;
+    p->sess = sess;
+    p->sta = FRAG_SESS_STA_ACTIVE;
+    memset(&p->dec, 0, sizeof(p->dec));
+    p->dec.cfg.dt = mgr->arena + (size_t)g * mgr->dec_len;
+    p->dec.cfg.maxlen = mgr->dec_len;
+    p->dec.cfg.nb = mgr->cfg.nb;
+    p->dec.cfg.size = mgr->cfg.size;
+    p->dec.cfg.tolerence = mgr->cfg.tolerence;
+    p->dec.cfg.faddr = g * mgr->store_len;
+    p->dec.cfg.frd_func = sess_flash_rd;
+    p->dec.cfg.fwr_func = sess_flash_wr;
+    p->dec.cfg.rcache = mgr->cfg.rcache;
+    if (frag_dec_init(&p->dec) < 0) {
+        /* not in the table yet, straight back to the free list */
+        p->sta = FRAG_SESS_STA_FREE;
+        p->next = sh->free_head;
+        sh->free_head = s;
+        return -1;
+    }
+    table_ins(sh, s);
+    return s;
+}
+
+static void sess_process(frag_sess_mgr_t *mgr, frag_sess_shard_t *sh, frag_sess_msg_t *msg)
+{
+    int32_t s;
+    int ret;
+    frag_sess_t *p;
+
+    s = table_find(sh, msg->devaddr, msg->sess);
+    if (msg->type == SESS_MSG_CLOSE) {
+        if (s >= 0) {
+            sess_release(sh, s);
+        }
+        return;
+    }
+
+    sh->stats.frames++;
+    if (s < 0) {
+        s = sess_open(mgr, sh, msg->devaddr, msg->sess);
+        if (s < 0) {
+            sh->stats.dropped++;
+            return;
+        }
+    }
+    p = &sh->sess[s];
+    if (p->sta == FRAG_SESS_STA_DONE) {
+        sh->stats.ignored++;
+        return;
+    }
+
+    ret = frag_dec(&p->dec, msg->fcnt, (uint8_t *)(msg + 1), mgr->cfg.size);
+    if (ret == FRAG_DEC_ONGOING) {
+        return;
+    }
+    if (ret == FRAG_DEC_ERR_INVALID_FRAME) {
+        /* a bad frame, the session goes on with the next one */
+        sh->stats.dropped++;
+        return;
+    }
+
+    p->sta = FRAG_SESS_STA_DONE;
+    done_push(sh, s);
+    if (ret >= 0) {
+        sh->stats.sess_done++;
+    } else {
+        sh->stats.sess_failed++;
+    }
+    if (mgr->cfg.done_func != NULL) {
+        mgr->cfg.done_func(mgr->cfg.done_arg, p->devaddr, p->sess, ret,
+                           (ret >= 0) ? sess_store + p->dec.cfg.faddr : NULL,
+                           (ret >= 0) ? mgr->store_len : 0);
+    }
+}
+
+static void *sess_worker(void *arg)
+{
+    frag_sess_shard_t *sh = arg;
+    frag_sess_mgr_t *mgr = sh->mgr;
+    frag_sess_msg_t *msg;
+
+    while (1) {
+        pthread_mutex_lock(&sh->lock);
+        while ((sh->count == 0) && !sh->stop) {
+            pthread_cond_wait(&sh->not_empty, &sh->lock);
+        }
+        if (sh->count == 0) {
+            pthread_mutex_unlock(&sh->lock);
+            break;
+        }
+        msg = (frag_sess_msg_t *)(sh->queue + (size_t)sh->head * mgr->msg_len);
+        pthread_mutex_unlock(&sh->lock);
+
+        /* the producer doesn't reuse the entry before count drops */
+        sess_process(mgr, sh, msg);
+
+        pthread_mutex_lock(&sh->lock);
+        sh->head = (sh->head + 1) % mgr->cfg.queue_len;
+        sh->count--;
+        pthread_cond_broadcast(&sh->not_full);
+        pthread_mutex_unlock(&sh->lock);
+    }
+    return NULL;
+}
+
+static int sess_post(frag_sess_mgr_t *mgr, frag_sess_msg_t *hdr, uint8_t *buf)
+{
+    frag_sess_shard_t *sh;
+    uint8_t *ent;
+
+    sh = sess_shard(mgr, hdr->devaddr, hdr->sess);
+    pthread_mutex_lock(&sh->lock);
+    while (sh->count == mgr->cfg.queue_len) {
+        pthread_cond_wait(&sh->not_full, &sh->lock);
+    }
+    ent = sh->queue + (size_t)((sh->head + sh->count) % mgr->cfg.queue_len) * mgr->msg_len;
+    memcpy(ent, hdr, sizeof(*hdr));
+    if (buf != NULL) {
+        memcpy(ent + sizeof(*hdr), buf, mgr->cfg.size);
+    }
+    sh->count++;
+    pthread_cond_signal(&sh->not_empty);
+    pthread_mutex_unlock(&sh->lock);
+    return 0;
+}
+
+static void sess_free(frag_sess_mgr_t *mgr, int cnt)
+{
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        free(mgr->shard[i].queue);
+        free(mgr->shard[i].sess);
+        free(mgr->shard[i].table);
+        pthread_mutex_destroy(&mgr->shard[i].lock);
+        pthread_cond_destroy(&mgr->shard[i].not_empty);
+        pthread_cond_destroy(&mgr->shard[i].not_full);
+    }
+    free(mgr->shard);
+    free(mgr->arena);
+    mgr->shard = NULL;
+    mgr->arena = NULL;
+    sess_store = NULL;
+}
+
+static void sess_stop(frag_sess_mgr_t *mgr, uint32_t cnt)
+{
+    uint32_t i;
+    frag_sess_shard_t *sh;
+
+    for (i = 0; i < cnt; i++) {
+        sh = &mgr->shard[i];
+        pthread_mutex_lock(&sh->lock);
+        sh->stop = true;
+        pthread_cond_signal(&sh->not_empty);
+        pthread_mutex_unlock(&sh->lock);
+        pthread_join(sh->thread, NULL);
+    }
+}
+
+int frag_sess_init(frag_sess_mgr_t *mgr, frag_sess_cfg_t *cfg)
+{
+    uint32_t i, j, per, base, tsize;
+    uint64_t store_total;
+    frag_sess_shard_t *sh;
+    frag_dec_cfg_t dcfg;
+
+    if ((cfg->workers == 0) || (cfg->max_sess < cfg->workers) || (cfg->queue_len == 0) || (cfg->size == 0)) {
+        return FRAG_SESS_ERR_PARAM;
+    }
+    if (sess_store != NULL) {
+        return FRAG_SESS_ERR_BUSY;
+    }
+
+    memset(mgr, 0, sizeof(*mgr));
+    mgr->cfg = *cfg;
+    mgr->cfg.tolerence = (cfg->tolerence > cfg->nb) ? cfg->nb : cfg->tolerence;
+    memset(&dcfg, 0, sizeof(dcfg));
+    dcfg.nb = cfg->nb;
+    dcfg.size = cfg->size;
+    dcfg.tolerence = mgr->cfg.tolerence;
+    mgr->dec_len = SESS_ALIGN_UP(frag_dec_mem_size(&dcfg));
+    mgr->store_len = (uint32_t)cfg->nb * cfg->size;
+    mgr->msg_len = (sizeof(frag_sess_msg_t) + cfg->size + 7) & ~7;
+
+    /* fragment addresses are 32 bits */
+    store_total = (uint64_t)cfg->max_sess * mgr->store_len;
+    if (store_total > UINT32_MAX) {
+        return FRAG_SESS_ERR_PARAM;
+    }
+
+    if (posix_memalign((void **)&mgr->arena, SESS_ALIGN, (size_t)cfg->max_sess * mgr->dec_len + store_total) != 0) {
+        mgr->arena = NULL;
+        return FRAG_SESS_ERR_NO_MEM;
+    }
+    sess_store = mgr->arena + (size_t)cfg->max_sess * mgr->dec_len;
+
+    mgr->shard = calloc(cfg->workers, sizeof(frag_sess_shard_t));
+    if (mgr->shard == NULL) {
+        sess_free(mgr, 0);
+        return FRAG_SESS_ERR_NO_MEM;
+    }
+
+    base = 0;
+    for (i = 0; i < cfg->workers; i++) {
+        sh = &mgr->shard[i];
+        per = cfg->max_sess / cfg->workers + ((i < cfg->max_sess % cfg->workers) ? 1 : 0);
+        for (tsize = 1; tsize < 2 * per; tsize <<= 1);
+
+        sh->mgr = mgr;
+        pthread_mutex_init(&sh->lock, NULL);
+        pthread_cond_init(&sh->not_empty, NULL);
+        pthread_cond_init(&sh->not_full, NULL);
+        sh->queue = malloc((size_t)cfg->queue_len * mgr->msg_len);
+        sh->sess = calloc(per, sizeof(frag_sess_t));
+        sh->table = malloc(tsize * sizeof(int32_t));
+        if (!sh->queue || !sh->sess || !sh->table) {
+            sess_free(mgr, i + 1);
+            return FRAG_SESS_ERR_NO_MEM;
+        }
+        sh->sess_cnt = per;
+        sh->base = base;
+        sh->table_mask = tsize - 1;
+        memset(sh->table, 0xff, tsize * sizeof(int32_t));
+        for (j = 0; j < per; j++) {
+            sh->sess[j].next = (j + 1 < per) ? (int32_t)(j + 1) : -1;
+        }
+        sh->free_head = 0;
+        sh->done_head = -1;
+        sh->done_tail = -1;
+        base += per;
+    }
+
+    for (i = 0; i < cfg->workers; i++) {
+        if (pthread_create(&mgr->shard[i].thread, NULL, sess_worker, &mgr->shard[i]) != 0) {
+            sess_stop(mgr, i);
+            sess_free(mgr, cfg->workers);
+            return FRAG_SESS_ERR_NO_MEM;
+        }
+    }
+    return 0;
+}
+
+/* queue one frame, blocks while the worker of the session is full */
+int frag_sess_put(frag_sess_mgr_t *mgr, uint32_t devaddr, uint8_t sess, uint16_t fcnt, uint8_t *buf, int len)
+{
+    frag_sess_msg_t hdr;
+
+    if ((len != mgr->cfg.size) || (fcnt == 0) || (fcnt > FRAG_N_MAX)) {
+        return FRAG_DEC_ERR_INVALID_FRAME;
+    }
+    hdr.devaddr = devaddr;
+    hdr.fcnt = fcnt;
+    hdr.sess = sess;
+    hdr.type = SESS_MSG_FRAME;
+    return sess_post(mgr, &hdr, buf);
+}
+
+/* drop a session, e.g. on timeout, its slot is free again */
+int frag_sess_close(frag_sess_mgr_t *mgr, uint32_t devaddr, uint8_t sess)
+{
+    frag_sess_msg_t hdr;
+
+    hdr.devaddr = devaddr;
+    hdr.fcnt = 0;
+    hdr.sess = sess;
+    hdr.type = SESS_MSG_CLOSE;
+    return sess_post(mgr, &hdr, NULL);
+}
+
+/* wait until every queued frame is processed */
+void frag_sess_flush(frag_sess_mgr_t *mgr)
+{
+    uint32_t i;
+    frag_sess_shard_t *sh;
+
+    for (i = 0; i < mgr->cfg.workers; i++) {
+        sh = &mgr->shard[i];
+        pthread_mutex_lock(&sh->lock);
+        while (sh->count != 0) {
+            pthread_cond_wait(&sh->not_full, &sh->lock);
+        }
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
+
+/* counters are exact after frag_sess_flush */
+void frag_sess_stats(frag_sess_mgr_t *mgr, frag_sess_stats_t *st)
+{
+    uint32_t i;
+    frag_sess_shard_t *sh;
+
+    memset(st, 0, sizeof(*st));
+    for (i = 0; i < mgr->cfg.workers; i++) {
+        sh = &mgr->shard[i];
+        pthread_mutex_lock(&sh->lock);
+        st->frames += sh->stats.frames;
+        st->dropped += sh->stats.dropped;
+        st->ignored += sh->stats.ignored;
+        st->sess_done += sh->stats.sess_done;
+        st->sess_failed += sh->stats.sess_failed;
+        st->sess_recycled += sh->stats.sess_recycled;
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
+
+/* stops the workers once the queued frames are processed */
+void frag_sess_deinit(frag_sess_mgr_t *mgr)
+{
+    sess_stop(mgr, mgr->cfg.workers);
+    sess_free(mgr, mgr->cfg.workers);
+}
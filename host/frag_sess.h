@@ -0,0 +1,112 @@
+#ifndef __FRAG_SESS_H
+#define __FRAG_SESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "frag.h"
+
+/*
+ Gateway side fragmentation session manager.
+
+ Sessions are keyed by (devaddr, session index). Every session gets a
+ decoder buffer and nb * size bytes of fragment storage carved from one
+ arena allocated at init, so no memory is allocated while frames flow.
+
+ Frames are hashed by key onto worker threads. Each worker owns its
+ sessions, hash table and free list, so decoder state is never shared
+ between threads; the only lock is the worker's frame queue.
+
+ A finished session (decoded or failed) is reported once through
+ cfg.done_func, from the worker thread. It stays in the table so that
+ late frames of the same session are ignored, and its slot is recycled
+ when a new session needs one or when frag_sess_close is called.
+
+ The fragment storage is reached through the decoder flash callbacks,
+ which carry no context, so only one manager can run per process.
+ */
+
+#define FRAG_SESS_ERR_PARAM         (-1)
+#define FRAG_SESS_ERR_NO_MEM        (-2)
+#define FRAG_SESS_ERR_BUSY          (-3)
+
+typedef struct frag_sess_mgr frag_sess_mgr_t;
+
+typedef void (*frag_sess_done_t)(void *arg, uint32_t devaddr, uint8_t sess, int ret, uint8_t *data, uint32_t len);
+
+typedef struct {
+    uint16_t nb;
+    uint8_t size;
+    uint16_t tolerence;
+    uint32_t max_sess;          // sessions held at once, over all workers
+    uint16_t workers;
+    uint32_t queue_len;         // frames queued per worker
+    frag_row_cache_t *rcache;   // optional, must be filled (frag_row_cache_fill)
+    frag_sess_done_t done_func;
+    void *done_arg;
+} frag_sess_cfg_t;
+
+typedef enum {
+    FRAG_SESS_STA_FREE,
+    FRAG_SESS_STA_ACTIVE,
+    FRAG_SESS_STA_DONE,
+} frag_sess_sta_t;
+
+typedef struct {
+    uint32_t devaddr;
+    uint8_t sess;
+    frag_sess_sta_t sta;
+    int32_t prev;               // free list (next only) or done list
+    int32_t next;
+    frag_dec_t dec;
+} frag_sess_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t dropped;           // invalid frames, frames of sessions that could not be opened
+    uint64_t ignored;           // frames of finished sessions
+    uint64_t sess_done;
+    uint64_t sess_failed;
+    uint64_t sess_recycled;
+} frag_sess_stats_t;
+
+typedef struct {
+    frag_sess_mgr_t *mgr;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t *queue;
+    uint32_t head;
+    uint32_t count;             // queued frames, the one in process included
+    bool stop;
+
+    frag_sess_t *sess;
+    uint32_t sess_cnt;
+    uint32_t base;              // global index of sess[0]
+    int32_t free_head;
+    int32_t done_head;          // oldest finished session
+    int32_t done_tail;
+    int32_t *table;
+    uint32_t table_mask;
+
+    frag_sess_stats_t stats;
+} frag_sess_shard_t;
+
+struct frag_sess_mgr {
+    frag_sess_cfg_t cfg;
+    uint8_t *arena;
+    uint32_t dec_len;           // decoder buffer per session, aligned
+    uint32_t store_len;         // fragment storage per session
+    uint32_t msg_len;           // queued frame, header and payload
+    frag_sess_shard_t *shard;
+};
+
+int frag_sess_init(frag_sess_mgr_t *mgr, frag_sess_cfg_t *cfg);
+int frag_sess_put(frag_sess_mgr_t *mgr, uint32_t devaddr, uint8_t sess, uint16_t fcnt, uint8_t *buf, int len);
+int frag_sess_close(frag_sess_mgr_t *mgr, uint32_t devaddr, uint8_t sess);
+void frag_sess_flush(frag_sess_mgr_t *mgr);
+void frag_sess_stats(frag_sess_mgr_t *mgr, frag_sess_stats_t *st);
+void frag_sess_deinit(frag_sess_mgr_t *mgr);
+
+#endif // __FRAG_SESS_H
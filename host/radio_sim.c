@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "radio_sim.h"
+
+#define RADIO_SIM_MAX_NODES     (8)
+
+typedef enum {
+    RADIO_SIM_EV_WAKE,
+    RADIO_SIM_EV_TX_DONE,
+    RADIO_SIM_EV_RX_DONE,
+    RADIO_SIM_EV_RX_TIMEOUT,
+    RADIO_SIM_EV_TIMER,
+} radio_sim_ev_type_t;
+
+typedef struct {
+    uint64_t t;
+    uint32_t seq;               // events of the same time run in order
+    radio_sim_ev_type_t type;
+    radio_sim_node_t *node;
+    uint32_t epoch;
+    int16_t rssi;
+    int8_t snr;
+    radio_sim_timer_t *timer;
+    uint32_t timer_gen;
+    uint8_t len;
+    uint8_t buf[256];
+} radio_sim_ev_t;
+
+typedef struct {
+    double loss;
+    int16_t rssi;
+    int8_t snr;
+} radio_sim_link_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // a node stopped running
+    uint64_t now;
+    uint32_t seq;
+    uint32_t rnd;
+
+    radio_sim_ev_t *heap;
+    uint32_t ev_cnt;
+    uint32_t ev_cap;
+
+    radio_sim_node_t node[RADIO_SIM_MAX_NODES];
+    int node_cnt;
+    radio_sim_link_t link[RADIO_SIM_MAX_NODES][RADIO_SIM_MAX_NODES];
+} sim;
+
+static __thread radio_sim_node_t *sim_self;
+
+static uint32_t radio_sim_rnd(void)
+{
+    uint32_t x = sim.rnd;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim.rnd = x;
+    return x;
+}
+
+static bool radio_sim_ev_before(radio_sim_ev_t *a, radio_sim_ev_t *b)
+{
+    return (a->t < b->t) || ((a->t == b->t) && (a->seq < b->seq));
+}
+
+static radio_sim_ev_t *radio_sim_push(uint64_t t, radio_sim_ev_type_t type, radio_sim_node_t *node)
+{
+    radio_sim_ev_t tmp, *ev;
+    uint32_t i, p;
+
+    if (sim.ev_cnt == sim.ev_cap) {
+        sim.ev_cap = sim.ev_cap ? 2 * sim.ev_cap : 64;
+        sim.heap = realloc(sim.heap, sim.ev_cap * sizeof(radio_sim_ev_t));
+        if (sim.heap == NULL) {
+            fprintf(stderr, "radio_sim: out of memory\n");
+            exit(1);
+        }
+    }
+    i = sim.ev_cnt++;
+    ev = &sim.heap[i];
+    memset(ev, 0, offsetof(radio_sim_ev_t, buf));
+    ev->t = t;
+    ev->seq = sim.seq++;
+    ev->type = type;
+    ev->node = node;
+    ev->epoch = node->epoch;
+    /* sift up, the caller fills the payload through the returned slot */
+    while (i > 0) {
+        p = (i - 1) / 2;
+        if (!radio_sim_ev_before(&sim.heap[i], &sim.heap[p])) {
+            break;
+        }
+        tmp = sim.heap[p];
+        sim.heap[p] = sim.heap[i];
+        sim.heap[i] = tmp;
+        i = p;
+    }
+    return &sim.heap[i];
+}
+
+static void radio_sim_pop(radio_sim_ev_t *out)
+{
+    radio_sim_ev_t tmp;
+    uint32_t i, c;
+
+    *out = sim.heap[0];
+    sim.heap[0] = sim.heap[--sim.ev_cnt];
+    i = 0;
+    for (;;) {
+        c = 2 * i + 1;
+        if (c >= sim.ev_cnt) {
+            break;
+        }
+        if ((c + 1 < sim.ev_cnt) && radio_sim_ev_before(&sim.heap[c + 1], &sim.heap[c])) {
+            c++;
+        }
+        if (!radio_sim_ev_before(&sim.heap[c], &sim.heap[i])) {
+            break;
+        }
+        tmp = sim.heap[c];
+        sim.heap[c] = sim.heap[i];
+        sim.heap[i] = tmp;
+        i = c;
+    }
+}
+
+int radio_sim_init(uint32_t seed)
+{
+    int i, j;
+
+    memset(&sim, 0, sizeof(sim));
+    pthread_mutex_init(&sim.lock, NULL);
+    pthread_cond_init(&sim.cond, NULL);
+    sim.rnd = seed ? seed : 1;
+    for (i = 0; i < RADIO_SIM_MAX_NODES; i++) {
+        for (j = 0; j < RADIO_SIM_MAX_NODES; j++) {
+            sim.link[i][j].loss = 0;
+            sim.link[i][j].rssi = -60;
+            sim.link[i][j].snr = 10;
+        }
+    }
+    return 0;
+}
+
+radio_sim_node_t *radio_sim_add(const char *name, radio_sim_main_t main_func, bool quiet)
+{
+    radio_sim_node_t *node;
+
+    if (sim.node_cnt == RADIO_SIM_MAX_NODES) {
+        return NULL;
+    }
+    node = &sim.node[sim.node_cnt];
+    node->id = sim.node_cnt++;
+    node->name = name;
+    node->main_func = main_func;
+    node->quiet = quiet;
+    node->line_start = true;
+    node->sta = RADIO_SIM_SLEEP;
+    pthread_cond_init(&node->cond, NULL);
+    return node;
+}
+
+void radio_sim_link(radio_sim_node_t *from, radio_sim_node_t *to, double loss, int16_t rssi, int8_t snr)
+{
+    sim.link[from->id][to->id].loss = loss;
+    sim.link[from->id][to->id].rssi = rssi;
+    sim.link[from->id][to->id].snr = snr;
+}
+
+uint64_t radio_sim_now(void)
+{
+    return sim.now;
+}
+
+radio_sim_node_t *radio_sim_self(void)
+{
+    return sim_self;
+}
+
+static void *radio_sim_thread(void *arg)
+{
+    radio_sim_node_t *node = arg;
+
+    sim_self = node;
+    pthread_mutex_lock(&sim.lock);
+    while (!node->running) {
+        pthread_cond_wait(&node->cond, &sim.lock);
+    }
+    node->main_func();
+    node->done = true;
+    node->running = false;
+    pthread_cond_signal(&sim.cond);
+    pthread_mutex_unlock(&sim.lock);
+    return NULL;
+}
+
+static void radio_sim_park(radio_sim_node_t *node)
+{
+    node->running = false;
+    pthread_cond_signal(&sim.cond);
+    while (!node->running) {
+        pthread_cond_wait(&node->cond, &sim.lock);
+    }
+}
+
+void radio_sim_wait(uint64_t us)
+{
+    radio_sim_node_t *node = sim_self;
+
+    if ((node == NULL) || !node->running) {
+        /* a wait inside a callback, the clock only moves between events */
+        return;
+    }
+    radio_sim_push(sim.now + us, RADIO_SIM_EV_WAKE, node);
+    radio_sim_park(node);
+}
+
+void radio_sim_idle(void)
+{
+    radio_sim_node_t *node = sim_self;
+
+    if ((node == NULL) || !node->running) {
+        return;
+    }
+    node->idle = true;
+    node->idle_since = sim.now;
+    radio_sim_park(node);
+}
+
+void radio_sim_timer_start(radio_sim_timer_t *t, uint64_t us)
+{
+    radio_sim_ev_t *ev;
+
+    t->gen++;
+    ev = radio_sim_push(sim.now + us, RADIO_SIM_EV_TIMER, t->node);
+    ev->timer = t;
+    ev->timer_gen = t->gen;
+}
+
+void radio_sim_timer_stop(radio_sim_timer_t *t)
+{
+    t->gen++;
+}
+
+void radio_sim_vprintf(const char *fmt, va_list ap)
+{
+    radio_sim_node_t *node = sim_self;
+    char line[512];
+    char *p, *nl;
+
+    if (node == NULL) {
+        vprintf(fmt, ap);
+        return;
+    }
+    if (node->quiet) {
+        return;
+    }
+    vsnprintf(line, sizeof(line), fmt, ap);
+    /* the clock and the node name in front of every line */
+    for (p = line; *p != '\0'; p = nl) {
+        if (node->line_start) {
+            printf("[%10.3f %s] ", sim.now / 1e6, node->name);
+        }
+        nl = strchr(p, '\n');
+        nl = (nl != NULL) ? nl + 1 : p + strlen(p);
+        fwrite(p, 1, nl - p, stdout);
+        node->line_start = nl[-1] == '\n';
+    }
+}
+
+int radio_sim_printf(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    radio_sim_vprintf(fmt, ap);
+    va_end(ap);
+    return 0;
+}
+
+void radio_sim_events(radio_sim_node_t *node, RadioEvents_t *events)
+{
+    node->events = events;
+}
+
+static void radio_sim_state(radio_sim_node_t *node, radio_sim_sta_t sta)
+{
+    if (node->sta == RADIO_SIM_RX) {
+        node->stats.rx_on_us += sim.now - node->rx_since;
+    }
+    node->sta = sta;
+    node->epoch++;
+    node->lock_until = 0;
+    if (sta == RADIO_SIM_RX) {
+        node->rx_since = sim.now;
+    }
+}
+
+void radio_sim_channel(radio_sim_node_t *node, uint32_t freq)
+{
+    node->freq = freq;
+}
+
+void radio_sim_config(radio_sim_node_t *node, RadioModems_t modem, uint32_t bandwidth, uint32_t datarate,
+                      uint8_t coderate, uint16_t preamble, bool fix_len, bool crc)
+{
+    node->modem = modem;
+    if (modem == MODEM_LORA) {
+        node->phy.sf = datarate;
+        node->phy.bw = bandwidth;
+        node->phy.cr = coderate;
+        node->phy.preamble = preamble;
+        node->phy.fix_len = fix_len;
+        node->phy.crc = crc;
+    } else {
+        node->fsk_rate = datarate;
+        node->fsk_preamble = preamble;
+        node->phy.fix_len = fix_len;
+        node->phy.crc = crc;
+    }
+}
+
+uint32_t radio_sim_toa(radio_sim_node_t *node, uint8_t len)
+{
+    if (node->modem == MODEM_LORA) {
+        return lora_toa_us(&node->phy, len);
+    }
+    return fsk_toa_us(node->fsk_rate, node->fsk_preamble, node->phy.fix_len, node->phy.crc, len);
+}
+
+static bool radio_sim_hears(radio_sim_node_t *tx, radio_sim_node_t *rx)
+{
+    if ((rx->sta != RADIO_SIM_RX) || (rx->freq != tx->freq) || (rx->modem != tx->modem)) {
+        return false;
+    }
+    if (tx->modem == MODEM_LORA) {
+        return (rx->phy.sf == tx->phy.sf) && (rx->phy.bw == tx->phy.bw);
+    }
+    return rx->fsk_rate == tx->fsk_rate;
+}
+
+void radio_sim_send(radio_sim_node_t *node, uint8_t *buf, uint8_t len)
+{
+    radio_sim_node_t *rx;
+    radio_sim_link_t *link;
+    radio_sim_ev_t *ev;
+    uint32_t toa;
+    int i;
+
+    radio_sim_state(node, RADIO_SIM_TX);
+    toa = radio_sim_toa(node, len);
+    if (node->stats.tx_frames == 0) {
+        node->stats.first_tx_us = sim.now;
+    }
+    node->stats.tx_frames++;
+    node->stats.tx_air_us += toa;
+    radio_sim_push(sim.now + toa, RADIO_SIM_EV_TX_DONE, node);
+
+    for (i = 0; i < sim.node_cnt; i++) {
+        rx = &sim.node[i];
+        if ((rx == node) || !radio_sim_hears(node, rx)) {
+            continue;
+        }
+        if (rx->lock_until > sim.now) {
+            rx->stats.rx_missed++;
+            continue;
+        }
+        link = &sim.link[node->id][rx->id];
+        if ((radio_sim_rnd() >> 8) < link->loss * (1 << 24)) {
+            rx->stats.rx_lost++;
+            continue;
+        }
+        rx->lock_until = sim.now + toa;
+        ev = radio_sim_push(sim.now + toa, RADIO_SIM_EV_RX_DONE, rx);
+        ev->rssi = link->rssi;
+        ev->snr = link->snr;
+        ev->len = len;
+        memcpy(ev->buf, buf, len);
+    }
+}
+
+void radio_sim_rx(radio_sim_node_t *node, uint32_t timeout_ms)
+{
+    radio_sim_state(node, RADIO_SIM_RX);
+    if (timeout_ms > 0) {
+        radio_sim_push(sim.now + (uint64_t)timeout_ms * 1000, RADIO_SIM_EV_RX_TIMEOUT, node);
+    }
+}
+
+void radio_sim_sleep(radio_sim_node_t *node)
+{
+    radio_sim_state(node, RADIO_SIM_SLEEP);
+}
+
+/* an interrupt ends the sleep of an idle node */
+static void radio_sim_irq_done(radio_sim_node_t *node)
+{
+    if (node->idle) {
+        node->idle = false;
+        node->stats.wakeups++;
+        node->stats.sleep_us += sim.now - node->idle_since;
+        radio_sim_push(sim.now, RADIO_SIM_EV_WAKE, node);
+    }
+}
+
+static void radio_sim_dispatch(radio_sim_ev_t *ev)
+{
+    radio_sim_node_t *node = ev->node;
+    RadioEvents_t *events = node->events;
+
+    if (ev->type == RADIO_SIM_EV_WAKE) {
+        node->running = true;
+        pthread_cond_signal(&node->cond);
+        while (node->running) {
+            pthread_cond_wait(&sim.cond, &sim.lock);
+        }
+        return;
+    }
+
+    if (ev->type == RADIO_SIM_EV_TIMER) {
+        /* stopped or restarted since */
+        if (ev->timer_gen != ev->timer->gen) {
+            return;
+        }
+        sim_self = node;
+        ev->timer->func(ev->timer->arg);
+        sim_self = NULL;
+        radio_sim_irq_done(node);
+        return;
+    }
+
+    if (ev->epoch != node->epoch) {
+        if (ev->type == RADIO_SIM_EV_RX_DONE) {
+            /* left RX before the end of the frame */
+            node->stats.rx_missed++;
+        }
+        return;
+    }
+    /* callbacks run as the node, as an IRQ would */
+    sim_self = node;
+    switch (ev->type) {
+    case RADIO_SIM_EV_TX_DONE:
+        radio_sim_state(node, RADIO_SIM_SLEEP);
+        node->stats.last_tx_us = sim.now;
+        if ((events != NULL) && (events->TxDone != NULL)) {
+            events->TxDone();
+        }
+        break;
+    case RADIO_SIM_EV_RX_DONE:
+        /* continuous RX, the driver only stops the timeout */
+        node->epoch++;
+        node->lock_until = 0;
+        node->stats.rx_frames++;
+        if (node->rx_len > ev->len) {
+            memset(ev->buf + ev->len, 0, node->rx_len - ev->len);
+        }
+        if (node->rx_len > 0) {
+            ev->len = node->rx_len;
+        }
+        if ((events != NULL) && (events->RxDone != NULL)) {
+            events->RxDone(ev->buf, ev->len, ev->rssi, ev->snr);
+        }
+        break;
+    case RADIO_SIM_EV_RX_TIMEOUT:
+        radio_sim_state(node, RADIO_SIM_SLEEP);
+        node->stats.rx_timeouts++;
+        if ((events != NULL) && (events->RxTimeout != NULL)) {
+            events->RxTimeout();
+        }
+        break;
+    default:
+        break;
+    }
+    sim_self = NULL;
+    radio_sim_irq_done(node);
+}
+
+uint64_t radio_sim_run(uint64_t limit_us, radio_sim_stop_t stop, void *arg)
+{
+    radio_sim_ev_t ev;
+    int i;
+
+    pthread_mutex_lock(&sim.lock);
+    for (i = 0; i < sim.node_cnt; i++) {
+        radio_sim_push(0, RADIO_SIM_EV_WAKE, &sim.node[i]);
+        pthread_create(&sim.node[i].thread, NULL, radio_sim_thread, &sim.node[i]);
+    }
+    while (sim.ev_cnt > 0) {
+        if (sim.heap[0].t > limit_us) {
+            sim.now = limit_us;
+            break;
+        }
+        radio_sim_pop(&ev);
+        sim.now = ev.t;
+        if ((ev.type == RADIO_SIM_EV_WAKE) && ev.node->done) {
+            continue;
+        }
+        radio_sim_dispatch(&ev);
+        if ((stop != NULL) && stop(arg)) {
+            break;
+        }
+    }
+    for (i = 0; i < sim.node_cnt; i++) {
+        if (sim.node[i].idle) {
+            sim.node[i].stats.sleep_us += sim.now - sim.node[i].idle_since;
+            sim.node[i].idle_since = sim.now;
+        }
+    }
+    /* the nodes stay parked, their main loops never return */
+    pthread_mutex_unlock(&sim.lock);
+    return sim.now;
+}
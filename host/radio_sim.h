@@ -0,0 +1,122 @@
+#ifndef __RADIO_SIM_H
+#define __RADIO_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include "sx1276-hal.h"
+#include "lora_toa.h"
+
+/*
+ In-process SX1276 stand-in on a virtual clock.
+
+ Every node runs its application main on its own thread, but only one
+ thread runs at a time: a node runs until it waits (wait_ms, wait), then
+ the scheduler moves the clock to the next event. Radio interrupts
+ (TxDone, RxDone, RxTimeout) run the node's RadioEvents_t callbacks at
+ their time while the node is parked, like an IRQ that interrupts a busy
+ wait, so a node sees their effect when its wait ends. A node parked by
+ radio_sim_idle (sleep, deepsleep) sleeps until its next interrupt, radio
+ or timer, has run.
+
+ A frame is heard by the nodes in RX on the same channel, modem, spreading
+ factor and bandwidth when the transmission starts, unless the link drops
+ it. Leaving RX before the end of the frame (timeout, Sleep, Send) loses
+ it. The first frame a receiver locks on wins, later overlapping ones are
+ not heard. Time on air follows lora_toa_us for LoRa, and for FSK the
+ preamble, sync word, length byte, payload and CRC at the bit rate. In
+ fixed length (implicit header) mode a receiver gets the payload length of
+ its RX config, whatever was sent.
+ */
+
+typedef struct radio_sim_node radio_sim_node_t;
+
+typedef int (*radio_sim_main_t)(void);
+
+typedef enum {
+    RADIO_SIM_SLEEP,
+    RADIO_SIM_RX,
+    RADIO_SIM_TX,
+} radio_sim_sta_t;
+
+typedef struct {
+    uint32_t tx_frames;
+    uint64_t tx_air_us;
+    uint64_t first_tx_us;
+    uint64_t last_tx_us;        // end of the last transmission
+    uint32_t rx_frames;
+    uint32_t rx_lost;           // dropped by the link
+    uint32_t rx_missed;         // receiver left RX or was locked on another frame
+    uint32_t rx_timeouts;
+    uint64_t rx_on_us;          // time spent in RX
+    uint32_t wakeups;           // interrupts that ended a sleep
+    uint64_t sleep_us;          // time parked in sleep or deepsleep
+} radio_sim_stats_t;
+
+struct radio_sim_node {
+    const char *name;
+    int id;
+    radio_sim_main_t main_func;
+    RadioEvents_t *events;
+    bool quiet;
+    bool line_start;
+
+    radio_sim_sta_t sta;
+    uint32_t epoch;             // bumped by every state change, stale events are dropped
+    uint64_t rx_since;
+    uint64_t lock_until;        // end of the frame being received
+    uint32_t freq;
+    RadioModems_t modem;
+    lora_phy_t phy;
+    uint32_t fsk_rate;
+    uint16_t fsk_preamble;
+    uint8_t rx_len;             // implicit header: every frame is received as this many bytes
+
+    bool running;
+    bool idle;                  // sleeping until the next interrupt
+    uint64_t idle_since;
+    bool done;                  // main returned
+    pthread_t thread;
+    pthread_cond_t cond;
+
+    radio_sim_stats_t stats;
+};
+
+/* one shot timer, its function runs as an interrupt of node */
+typedef struct {
+    radio_sim_node_t *node;
+    void (*func)(void *arg);
+    void *arg;
+    uint32_t gen;               // bumped by start and stop, older expiries are dropped
+} radio_sim_timer_t;
+
+/* stop condition, checked after every event */
+typedef bool (*radio_sim_stop_t)(void *arg);
+
+int radio_sim_init(uint32_t seed);
+radio_sim_node_t *radio_sim_add(const char *name, radio_sim_main_t main_func, bool quiet);
+/* frames of from are dropped at to with probability loss, and received with rssi and snr */
+void radio_sim_link(radio_sim_node_t *from, radio_sim_node_t *to, double loss, int16_t rssi, int8_t snr);
+/* run until stop returns true or the clock passes limit_us, returns the clock */
+uint64_t radio_sim_run(uint64_t limit_us, radio_sim_stop_t stop, void *arg);
+uint64_t radio_sim_now(void);
+
+/* used by the mbed and SX1276 stand-ins, from a node thread or a callback */
+radio_sim_node_t *radio_sim_self(void);
+void radio_sim_wait(uint64_t us);
+void radio_sim_idle(void);
+void radio_sim_timer_start(radio_sim_timer_t *t, uint64_t us);
+void radio_sim_timer_stop(radio_sim_timer_t *t);
+void radio_sim_vprintf(const char *fmt, va_list ap);
+int radio_sim_printf(const char *fmt, ...);
+void radio_sim_events(radio_sim_node_t *node, RadioEvents_t *events);
+void radio_sim_channel(radio_sim_node_t *node, uint32_t freq);
+void radio_sim_config(radio_sim_node_t *node, RadioModems_t modem, uint32_t bandwidth, uint32_t datarate,
+                      uint8_t coderate, uint16_t preamble, bool fix_len, bool crc);
+uint32_t radio_sim_toa(radio_sim_node_t *node, uint8_t len);
+void radio_sim_send(radio_sim_node_t *node, uint8_t *buf, uint8_t len);
+void radio_sim_rx(radio_sim_node_t *node, uint32_t timeout_ms);
+void radio_sim_sleep(radio_sim_node_t *node);
+
+#endif // __RADIO_SIM_H
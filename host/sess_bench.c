@@ -0,0 +1,163 @@
+/*
+ Load generator for the session manager (frag_sess.c).
+
+ Build (from the repository root):
+   gcc -O2 -pthread -I. -Ihost -o sess_bench host/sess_bench.c host/frag_sess.c frag.c bitmap.c xorbuf.c
+
+ Usage:
+   sess_bench [-d devices] [-w workers] [-n nb] [-s size] [-l loss] [-m max_sess]
+
+ Every device sends the same data block, encoded with nb / 2 coded
+ fragments, through its own i.i.d. lossy channel. Frames of all devices
+ are interleaved as they would arrive at a gateway. Reported: ingest rate
+ and the number of decoded, failed and corrupted sessions.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "frag.h"
+#include "frag_sess.h"
+
+typedef struct {
+    uint8_t *block;
+    uint32_t len;
+    volatile uint32_t corrupted;
+} bench_ctx_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t rnd_next(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return x;
+}
+
+static void on_done(void *arg, uint32_t devaddr, uint8_t sess, int ret, uint8_t *data, uint32_t len)
+{
+    bench_ctx_t *ctx = arg;
+
+    (void)devaddr;
+    (void)sess;
+    if ((ret >= 0) && ((len != ctx->len) || (memcmp(data, ctx->block, len) != 0))) {
+        __atomic_add_fetch(&ctx->corrupted, 1, __ATOMIC_RELAXED);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    frag_sess_mgr_t mgr;
+    frag_sess_cfg_t cfg;
+    frag_sess_stats_t st;
+    frag_enc_t enc;
+    frag_row_cache_t rcache;
+    bench_ctx_t ctx;
+    uint8_t *frames, *line_buf, *rc_buf;
+    uint32_t devices, max_sess, seed, d, f, total, rc_len;
+    int i, nb, size, cr, workers, ret;
+    double loss;
+    uint64_t t0, t1;
+
+    devices = 10000;
+    workers = 4;
+    nb = 64;
+    size = 51;
+    loss = 0.1;
+    max_sess = 0;
+    for (i = 1; i + 1 < argc; i += 2) {
+        switch (argv[i][1]) {
+        case 'd': devices = strtoul(argv[i + 1], NULL, 0); break;
+        case 'w': workers = atoi(argv[i + 1]); break;
+        case 'n': nb = atoi(argv[i + 1]); break;
+        case 's': size = atoi(argv[i + 1]); break;
+        case 'l': loss = atof(argv[i + 1]); break;
+        case 'm': max_sess = strtoul(argv[i + 1], NULL, 0); break;
+        default:
+            printf("usage: %s [-d devices] [-w workers] [-n nb] [-s size] [-l loss] [-m max_sess]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (max_sess == 0) {
+        /* headroom for sessions that don't spread evenly over the workers */
+        max_sess = devices + devices / 4 + 64;
+    }
+    cr = nb / 2;
+
+    /* source block and all of its fragments */
+    ctx.len = nb * size;
+    ctx.block = malloc(ctx.len);
+    ctx.corrupted = 0;
+    frames = malloc((size_t)(nb + cr) * size);
+    line_buf = malloc(FRAG_ENC_LINE_LEN(nb));
+    rc_len = FRAG_ROW_CACHE_LEN(nb, cr);
+    rc_buf = malloc(rc_len);
+    seed = 0x12345678;
+    for (f = 0; f < ctx.len; f++) {
+        ctx.block[f] = (uint8_t)rnd_next(&seed);
+    }
+    frag_row_cache_init(&rcache, rc_buf, rc_len, nb, cr);
+    frag_row_cache_fill(&rcache);
+    memset(&enc, 0, sizeof(enc));
+    enc.dt = line_buf;
+    enc.maxlen = FRAG_ENC_LINE_LEN(nb);
+    enc.rcache = &rcache;
+    frag_enc_init(&enc, ctx.block, ctx.len, size);
+    for (f = 0; f < (uint32_t)(nb + cr); f++) {
+        frag_enc_next(&enc, f + 1, frames + f * size);
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.nb = nb;
+    cfg.size = size;
+    cfg.tolerence = 10 + (int)(nb * (loss + 0.1));
+    cfg.max_sess = max_sess;
+    cfg.workers = workers;
+    cfg.queue_len = 1024;
+    cfg.rcache = &rcache;
+    cfg.done_func = on_done;
+    cfg.done_arg = &ctx;
+    ret = frag_sess_init(&mgr, &cfg);
+    if (ret != 0) {
+        printf("frag_sess_init error %d\n", ret);
+        return 1;
+    }
+
+    total = 0;
+    t0 = now_ns();
+    for (f = 0; f < (uint32_t)(nb + cr); f++) {
+        for (d = 0; d < devices; d++) {
+            if ((rnd_next(&seed) >> 8) < (uint32_t)(loss * (1 << 24))) {
+                continue;
+            }
+            frag_sess_put(&mgr, 0x26000000 + d, 0, f + 1, frames + f * size, size);
+            total++;
+        }
+    }
+    frag_sess_flush(&mgr);
+    t1 = now_ns();
+
+    frag_sess_stats(&mgr, &st);
+    printf("devices %u, workers %d, nb %d, size %d, loss %.2f\n", devices, workers, nb, size, loss);
+    printf("frames %u in %.3f s, %.0f frames/s\n", total, (t1 - t0) / 1e9, total / ((t1 - t0) / 1e9));
+    printf("decoded %llu, failed %llu, corrupted %u, dropped %llu, ignored %llu, recycled %llu\n",
+           (unsigned long long)st.sess_done, (unsigned long long)st.sess_failed, ctx.corrupted,
+           (unsigned long long)st.dropped, (unsigned long long)st.ignored,
+           (unsigned long long)st.sess_recycled);
+
+    frag_sess_deinit(&mgr);
+    free(ctx.block);
+    free(frames);
+    free(line_buf);
+    free(rc_buf);
+    return 0;
+}
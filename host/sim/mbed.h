@@ -0,0 +1,75 @@
+#ifndef __MBED_SIM_H
+#define __MBED_SIM_H
+
+/*
+ Host stand-in for the mbed calls main.cpp makes, on the radio_sim clock.
+ printf and debug go through radio_sim_vprintf, which prefixes every line
+ with the clock and the node name.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "sx1276-hal.h"
+
+#define USBTX               0
+#define USBRX               1
+
+class RawSerial {
+public:
+    RawSerial(int tx, int rx) { (void)tx; (void)rx; }
+    /* the demo waits for '1' before it starts */
+    int getc(void) { return '1'; }
+};
+
+/* mbed Timer on the simulated clock */
+class Timer {
+public:
+    Timer() : t0(0), acc(0), on(false) {}
+    void start(void) { if (!on) { t0 = radio_sim_now(); on = true; } }
+    void stop(void) { if (on) { acc += radio_sim_now() - t0; on = false; } }
+    void reset(void) { acc = 0; t0 = radio_sim_now(); }
+    int read_us(void) { return (int)(acc + (on ? radio_sim_now() - t0 : 0)); }
+    int read_ms(void) { return read_us() / 1000; }
+private:
+    uint64_t t0;
+    uint64_t acc;
+    bool on;
+};
+
+/* mbed Timeout, the function runs as an interrupt of the node */
+class Timeout {
+public:
+    Timeout() : fn(NULL) { t.node = NULL; t.func = &Timeout::irq; t.arg = this; t.gen = 0; }
+    void attach_us(void (*f)(void), uint32_t us)
+    {
+        fn = f;
+        t.node = radio_sim_self();
+        radio_sim_timer_start(&t, us);
+    }
+    void attach(void (*f)(void), float s) { attach_us(f, (uint32_t)(s * 1e6f)); }
+    void detach(void) { radio_sim_timer_stop(&t); }
+private:
+    static void irq(void *arg) { ((Timeout *)arg)->fn(); }
+    radio_sim_timer_t t;
+    void (*fn)(void);
+};
+
+/* one node runs at a time, interrupts only run while it is parked */
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+static inline void sleep(void) { radio_sim_idle(); }
+static inline void deepsleep(void) { radio_sim_idle(); }
+
+/* microseconds, wraps as the 32 bit mbed ticker does */
+static inline uint32_t us_ticker_read(void) { return (uint32_t)radio_sim_now(); }
+
+static inline void wait_ms(int ms) { radio_sim_wait((uint64_t)ms * 1000); }
+static inline void wait_us(int us) { radio_sim_wait(us); }
+static inline void wait(float s) { radio_sim_wait((uint64_t)(s * 1e6f)); }
+
+#define printf              radio_sim_printf
+#define debug               radio_sim_printf
+#define debug_if(c, ...)    do { if (c) { radio_sim_printf(__VA_ARGS__); } } while (0)
+
+#endif // __MBED_SIM_H
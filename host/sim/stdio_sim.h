@@ -0,0 +1,14 @@
+#ifndef __STDIO_SIM_H
+#define __STDIO_SIM_H
+
+/*
+ Forced in front of the codec sources (-include) in the app_sim build, so
+ that their log lines carry the clock and node prefix and follow -v.
+ */
+
+#include <stdio.h>
+#include "radio_sim.h"
+
+#define printf              radio_sim_printf
+
+#endif // __STDIO_SIM_H
@@ -0,0 +1,80 @@
+#ifndef __SX1276_HAL_SIM_H
+#define __SX1276_HAL_SIM_H
+
+/*
+ Host stand-in for the SX1276Lib driver, only what main.cpp uses. Calls go
+ to radio_sim.c on the node that called Init.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    MODEM_FSK = 0,
+    MODEM_LORA,
+} RadioModems_t;
+
+typedef struct {
+    void (*TxDone)(void);
+    void (*TxTimeout)(void);
+    void (*RxDone)(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr);
+    void (*RxTimeout)(void);
+    void (*RxError)(void);
+    void (*FhssChangeChannel)(uint8_t currentChannel);
+    void (*CadDone)(bool channelActivityDetected);
+} RadioEvents_t;
+
+#define REG_VERSION         0x42
+
+#ifdef __cplusplus
+
+extern "C" {
+#include "radio_sim.h"
+}
+
+typedef enum {
+    SX1276MB1LAS,
+    SX1276MB1MAS,
+    SX1276UNDEFINED,
+} BoardType_t;
+
+class SX1276MB1xAS {
+public:
+    SX1276MB1xAS(void *events) : node(NULL) { (void)events; }
+
+    void Init(RadioEvents_t *events)
+    {
+        node = radio_sim_self();
+        radio_sim_events(node, events);
+    }
+    uint8_t Read(uint8_t addr) { return (addr == REG_VERSION) ? 0x12 : 0; }
+    BoardType_t DetectBoardType(void) { return SX1276MB1LAS; }
+    void SetChannel(uint32_t freq) { radio_sim_channel(node, freq); }
+    void SetTxConfig(RadioModems_t modem, int8_t power, uint32_t fdev, uint32_t bandwidth, uint32_t datarate,
+                     uint8_t coderate, uint16_t preambleLen, bool fixLen, bool crcOn, bool freqHopOn,
+                     uint8_t hopPeriod, bool iqInverted, uint32_t timeout)
+    {
+        radio_sim_config(node, modem, bandwidth, datarate, coderate, preambleLen, fixLen, crcOn);
+    }
+    void SetRxConfig(RadioModems_t modem, uint32_t bandwidth, uint32_t datarate, uint8_t coderate,
+                     uint32_t bandwidthAfc, uint16_t preambleLen, uint16_t symbTimeout, bool fixLen,
+                     uint8_t payloadLen, bool crcOn, bool freqHopOn, uint8_t hopPeriod,
+                     bool iqInverted, bool rxContinuous)
+    {
+        radio_sim_config(node, modem, bandwidth, datarate, coderate, preambleLen, fixLen, crcOn);
+        node->rx_len = fixLen ? payloadLen : 0;
+    }
+    uint32_t TimeOnAir(RadioModems_t modem, uint8_t pktLen) { return radio_sim_toa(node, pktLen) / 1000; }
+    void Send(uint8_t *buffer, uint8_t size) { radio_sim_send(node, buffer, size); }
+    void Rx(uint32_t timeout) { radio_sim_rx(node, timeout); }
+    void Sleep(void) { radio_sim_sleep(node); }
+    void Standby(void) { radio_sim_sleep(node); }
+
+private:
+    radio_sim_node_t *node;
+};
+
+#endif // __cplusplus
+
+#endif // __SX1276_HAL_SIM_H
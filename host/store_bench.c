@@ -0,0 +1,337 @@
+/*
+ Flash wear and time of the decoder storage, on the NOR flash simulator.
+
+ Build (from the repository root):
+   gcc -O2 -I. -Ihost -o store_bench host/store_bench.c host/flash_sim.c frag_store.c frag.c bitmap.c xorbuf.c
+
+ Usage:
+   store_bench [-n nb] [-s size] [-c coding_rate] [-l loss] [-p page_size]
+               [-e sector_size] [-g log_sectors] [-f cache_len] [-r seed]
+
+ One block is encoded, sent through an i.i.d. lossy channel and decoded
+ three times on the simulated flash:
+   in place   fragments at index * size, a rewrite of programmed bytes
+              reads, erases and reprograms the whole sector
+   log        frag_store.c, rewrites are appended to a log which is
+              merged back when full and at the end
+   log+lost   same with cfg.lost_bm set, rows of lost fragments are
+              logged from their first write
+ The log holds two records per tolerated lost fragment unless -g is given.
+ Reported: fragment writes of the decoder, bytes programmed, write
+ amplification (bytes programmed / bytes written by the decoder), sector
+ erases, highest erase count of one sector and estimated flash busy time.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "frag.h"
+#include "frag_store.h"
+#include "flash_sim.h"
+
+typedef struct {
+    int nb;
+    int size;
+    double rate;
+    double loss;
+    uint32_t page_size;
+    uint32_t sector_size;
+    int log_sectors;
+    uint32_t cache_len;
+    uint32_t seed;
+} bench_cfg_t;
+
+static flash_sim_t sim;
+static frag_store_t store;
+static uint8_t *sector_buf;
+static uint32_t wr_cnt;
+
+static uint32_t rnd_next(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return x;
+}
+
+static int sim_prog(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    uint32_t n;
+
+    while (len > 0) {
+        n = sim.page_size - addr % sim.page_size;
+        if (n > len) {
+            n = len;
+        }
+        if (flash_sim_write(&sim, addr, buf, n) < 0) {
+            return -1;
+        }
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* in place storage, read-modify-erase-write when the bytes are programmed already */
+static int inplace_write(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    uint32_t i, s, start, lo, hi, p;
+
+    wr_cnt++;
+    flash_sim_read(&sim, addr, sector_buf, len);
+    for (i = 0; i < len; i++) {
+        if (sector_buf[i] != 0xFF) {
+            break;
+        }
+    }
+    if (i == len) {
+        return sim_prog(addr, buf, len);
+    }
+    for (s = addr / sim.sector_size; s <= (addr + len - 1) / sim.sector_size; s++) {
+        start = s * sim.sector_size;
+        flash_sim_read(&sim, start, sector_buf, sim.sector_size);
+        lo = (addr > start) ? addr : start;
+        hi = (addr + len < start + sim.sector_size) ? addr + len : start + sim.sector_size;
+        memcpy(sector_buf + lo - start, buf + lo - addr, hi - lo);
+        flash_sim_erase(&sim, start);
+        for (p = 0; p < sim.sector_size; p += sim.page_size) {
+            for (i = 0; i < sim.page_size; i++) {
+                if (sector_buf[p + i] != 0xFF) {
+                    break;
+                }
+            }
+            if ((i < sim.page_size) && (flash_sim_write(&sim, start + p, sector_buf + p, sim.page_size) < 0)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int inplace_read(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    return flash_sim_read(&sim, addr, buf, len);
+}
+
+static int log_write(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    wr_cnt++;
+    return frag_store_write(&store, addr, buf, len);
+}
+
+static int log_read(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    return frag_store_read(&store, addr, buf, len);
+}
+
+static int sim_read(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    return flash_sim_read(&sim, addr, buf, len);
+}
+
+static int sim_write(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    return flash_sim_write(&sim, addr, buf, len);
+}
+
+static int sim_erase(uint32_t addr)
+{
+    return flash_sim_erase(&sim, addr);
+}
+
+static int bench_tol(bench_cfg_t *cfg)
+{
+    int tol;
+
+    tol = 10 + (int)(cfg->nb * (cfg->loss + 0.1));
+    return (tol > cfg->nb) ? cfg->nb : tol;
+}
+
+/*
+ decode the block in enc_buf, fragments stored through frd / fwr.
+ st: store behind frd / fwr, compacted at the end, NULL if none
+ */
+static int run_dec(bench_cfg_t *cfg, uint8_t *enc_buf, int cr, flash_rd_t frd, flash_wr_t fwr,
+                   frag_store_t *st, bool hint, int *sent)
+{
+    frag_dec_t decobj;
+    uint8_t *dec_buf;
+    uint32_t s;
+    int i, ret;
+
+    memset(&decobj, 0, sizeof(decobj));
+    decobj.cfg.nb = cfg->nb;
+    decobj.cfg.size = cfg->size;
+    decobj.cfg.tolerence = bench_tol(cfg);
+    decobj.cfg.cache_len = cfg->cache_len;
+    decobj.cfg.frd_func = frd;
+    decobj.cfg.fwr_func = fwr;
+    decobj.cfg.maxlen = frag_dec_mem_size(&decobj.cfg);
+    dec_buf = malloc(decobj.cfg.maxlen);
+    decobj.cfg.dt = dec_buf;
+    ret = frag_dec_init(&decobj);
+    if (ret < 0) {
+        free(dec_buf);
+        return ret;
+    }
+    if (st != NULL) {
+        st->cfg.lost_bm = hint ? decobj.lost_frm_bm : NULL;
+    }
+
+    s = cfg->seed ^ 0x5a5a5a5a;
+    ret = FRAG_DEC_ONGOING;
+    *sent = 0;
+    for (i = 0; i < cfg->nb + cr; i++) {
+        (*sent)++;
+        if ((rnd_next(&s) >> 8) < (uint32_t)(cfg->loss * (1 << 24))) {
+            continue;
+        }
+        ret = frag_dec(&decobj, i + 1, enc_buf + i * cfg->size, cfg->size);
+        if (ret != FRAG_DEC_ONGOING) {
+            break;
+        }
+    }
+    if (st != NULL) {
+        if (ret >= 0) {
+            frag_store_compact(st);
+        }
+        st->cfg.lost_bm = NULL;
+    }
+    free(dec_buf);
+    return ret;
+}
+
+static void report(const char *name, bench_cfg_t *cfg, int ret, bool match)
+{
+    double wa;
+
+    wa = (wr_cnt > 0) ? (double)sim.prog_bytes / ((double)wr_cnt * cfg->size) : 0;
+    printf("%-9s | %7u %10llu %6.2f | %7u %6u | %10.1f | %5u | %s",
+           name, wr_cnt, (unsigned long long)sim.prog_bytes, wa, sim.erases, flash_sim_max_erase(&sim),
+           sim.busy_us / 1000.0, sim.errors, ((ret >= 0) && match) ? "ok" : "fail");
+    if (ret < 0) {
+        printf(" (%d)", ret);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    bench_cfg_t cfg;
+    frag_enc_t encobj;
+    uint8_t *enc_buf, *out, *st_buf;
+    uint32_t s, enc_len, data_len, sectors;
+    int i, cr, ret, sent;
+
+    cfg.nb = 256;
+    cfg.size = 51;
+    cfg.rate = 0.7;
+    cfg.loss = 0.1;
+    cfg.page_size = 256;
+    cfg.sector_size = 4096;
+    cfg.log_sectors = 0;
+    cfg.cache_len = 0;
+    cfg.seed = 0x12345678;
+    for (i = 1; i + 1 < argc; i += 2) {
+        switch (argv[i][1]) {
+        case 'n': cfg.nb = atoi(argv[i + 1]); break;
+        case 's': cfg.size = atoi(argv[i + 1]); break;
+        case 'c': cfg.rate = atof(argv[i + 1]); break;
+        case 'l': cfg.loss = atof(argv[i + 1]); break;
+        case 'p': cfg.page_size = strtoul(argv[i + 1], NULL, 0); break;
+        case 'e': cfg.sector_size = strtoul(argv[i + 1], NULL, 0); break;
+        case 'g': cfg.log_sectors = atoi(argv[i + 1]); break;
+        case 'f': cfg.cache_len = strtoul(argv[i + 1], NULL, 0); break;
+        case 'r': cfg.seed = strtoul(argv[i + 1], NULL, 0); break;
+        default:
+            printf("usage: %s [-n nb] [-s size] [-c coding_rate] [-l loss] [-p page_size] "
+                   "[-e sector_size] [-g log_sectors] [-f cache_len] [-r seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (i < argc) {
+        printf("missing value for %s\n", argv[i]);
+        return 1;
+    }
+
+    if (cfg.log_sectors <= 0) {
+        cfg.log_sectors = (2 * bench_tol(&cfg) * (cfg.size + 4) + cfg.sector_size - 1) / cfg.sector_size;
+    }
+    cr = (int)(cfg.nb / cfg.rate + 0.5) - cfg.nb;
+    if (cr < 1) {
+        cr = 1;
+    }
+    data_len = cfg.nb * cfg.size;
+    enc_len = data_len + cr * cfg.size + FRAG_ENC_TILE_LEN(cfg.nb);
+    enc_buf = malloc(enc_len);
+    out = malloc(data_len);
+    sector_buf = malloc(cfg.sector_size);
+    s = cfg.seed;
+    for (i = 0; i < (int)data_len; i++) {
+        enc_buf[i] = (uint8_t)rnd_next(&s);
+    }
+    memset(&encobj, 0, sizeof(encobj));
+    encobj.dt = enc_buf;
+    encobj.maxlen = enc_len;
+    ret = frag_enc(&encobj, enc_buf, data_len, cfg.size, cr);
+    if (ret != 0) {
+        printf("frag_enc error %d\n", ret);
+        return 1;
+    }
+
+    memset(&store, 0, sizeof(store));
+    store.cfg.nb = cfg.nb;
+    store.cfg.size = cfg.size;
+    store.cfg.page_size = cfg.page_size;
+    store.cfg.sector_size = cfg.sector_size;
+    store.cfg.log_sectors = cfg.log_sectors;
+    sectors = frag_store_flash_size(&store.cfg) / cfg.sector_size;
+
+    printf("nb %d, size %d, cr %d, loss %.2f, page %u, sector %u, log sectors %d, cache %u\n",
+           cfg.nb, cfg.size, cr, cfg.loss, cfg.page_size, cfg.sector_size, cfg.log_sectors, cfg.cache_len);
+    printf("%-9s | %7s %10s %6s | %7s %6s | %10s | %5s | %s\n",
+           "storage", "frag wr", "prog B", "WA", "erases", "max/s", "busy ms", "err", "result");
+
+    /* in place */
+    if (flash_sim_init(&sim, cfg.page_size, cfg.sector_size, sectors) != 0) {
+        printf("flash_sim_init error\n");
+        return 1;
+    }
+    wr_cnt = 0;
+    ret = run_dec(&cfg, enc_buf, cr, inplace_read, inplace_write, NULL, false, &sent);
+    flash_sim_read(&sim, 0, out, data_len);
+    report("in place", &cfg, ret, memcmp(out, enc_buf, data_len) == 0);
+    flash_sim_deinit(&sim);
+
+    /* log structured, without and with the lost fragment hint */
+    store.cfg.maxlen = frag_store_mem_size(&store.cfg);
+    st_buf = malloc(store.cfg.maxlen + sizeof(bm_t));
+    store.cfg.dt = st_buf;
+    store.cfg.rd_func = sim_read;
+    store.cfg.wr_func = sim_write;
+    store.cfg.er_func = sim_erase;
+    for (i = 0; i < 2; i++) {
+        flash_sim_init(&sim, cfg.page_size, cfg.sector_size, sectors);
+        if (frag_store_init(&store) < 0) {
+            printf("frag_store_init error\n");
+            return 1;
+        }
+        flash_sim_reset_stats(&sim);
+        wr_cnt = 0;
+        ret = run_dec(&cfg, enc_buf, cr, log_read, log_write, &store, i == 1, &sent);
+        flash_sim_read(&sim, 0, out, data_len);
+        report((i == 0) ? "log" : "log+lost", &cfg, ret, memcmp(out, enc_buf, data_len) == 0);
+        printf("%-9s   %u of %u fragment writes appended, %u compactions\n",
+               "", store.log_cnt, store.wr_cnt, store.compact_cnt);
+        flash_sim_deinit(&sim);
+    }
+
+    free(st_buf);
+    free(enc_buf);
+    free(out);
+    free(sector_buf);
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ Offline decoder of the trace dumps of trace.c.
+
+ Build (from the repository root):
+   gcc -O2 -I. -o trace_dec host/trace_dec.c
+
+ Usage:
+   trace_dec [-x] [file]
+
+ Reads a dump as trace_dump writes it, from file or stdin, and prints
+ every record with its timestamp, the time since the previous record, the
+ event name and its arguments formatted with TRACE_EVENTS of trace.h. With
+ -x the input is a console log: the hex after "TRACE " on every line is
+ read, other lines are skipped, and each dump is labelled with the text
+ that comes before "TRACE " on its first line (the node name of app_sim -v).
+ Several dumps in a row are decoded one after the other. Dumps are little
+ endian, as written by the Cortex-M targets and x86 hosts.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "trace.h"
+
+#define TRACE_DEC_LINE_MAX      (1024)
+#define TRACE_DEC_NAME_OFS      (6) // "TRACE_"
+
+typedef struct {
+    const char *name;
+    const char *fmt;
+} trace_dec_ev_t;
+
+#define TRACE_DEC_EV(id, fmt)   { #id, fmt },
+static const trace_dec_ev_t trace_dec_ev[TRACE_ID_MAX] = {
+    { "TRACE_NONE", "%u %u %u" },
+    TRACE_EVENTS(TRACE_DEC_EV)
+};
+
+typedef struct {
+    uint8_t buf[sizeof(trace_hdr_t) > sizeof(trace_rec_t) ? sizeof(trace_hdr_t) : sizeof(trace_rec_t)];
+    uint32_t len;               // bytes in buf
+    bool in_dump;               // header read, records follow
+    uint32_t rec_len;
+    uint32_t left;              // records left in the dump
+    uint32_t recs;              // records printed from the dump
+    uint32_t ts_last;
+    uint32_t dumps;
+} trace_dec_t;
+
+static uint32_t rd16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void trace_dec_rec(trace_dec_t *d)
+{
+    uint32_t ts, id, a, b, c;
+
+    ts = rd32(d->buf);
+    id = d->buf[4];
+    a = rd16(d->buf + 6);
+    b = rd32(d->buf + 8);
+    c = rd32(d->buf + 12);
+
+    printf("%10u %+9d  ", ts, (d->recs++ == 0) ? 0 : (int)(ts - d->ts_last));
+    d->ts_last = ts;
+    if (id >= TRACE_ID_MAX) {
+        printf("id %u: %u %u %u\n", id, a, b, c);
+        return;
+    }
+    printf("%-18s ", trace_dec_ev[id].name + TRACE_DEC_NAME_OFS);
+    printf(trace_dec_ev[id].fmt, (unsigned)a, (unsigned)b, (unsigned)c);
+    printf("\n");
+}
+
+/* one byte of the dump, label names the dump a header starts */
+static void trace_dec_byte(trace_dec_t *d, uint8_t x, const char *label)
+{
+    d->buf[d->len++] = x;
+    if (!d->in_dump) {
+        /* slide over anything up to the magic */
+        if ((d->len == 4) && (rd32(d->buf) != TRACE_MAGIC)) {
+            memmove(d->buf, d->buf + 1, 3);
+            d->len = 3;
+            return;
+        }
+        if (d->len < sizeof(trace_hdr_t)) {
+            return;
+        }
+        d->rec_len = rd16(d->buf + 4);
+        d->left = rd32(d->buf + 12);
+        d->len = 0;
+        if (d->rec_len != sizeof(trace_rec_t)) {
+            printf("dump with %u byte records, skipped\n", d->rec_len);
+            return;
+        }
+        printf("dump %u%s%s: %u records of %u written\n", ++d->dumps, (label[0] != '\0') ? " " : "", label,
+               d->left, rd32(d->buf + 8));
+        printf("%10s %9s  %-18s %s\n", "us", "delta", "event", "arguments");
+        d->recs = 0;
+        d->in_dump = (d->left > 0);
+        return;
+    }
+    if (d->len < d->rec_len) {
+        return;
+    }
+    trace_dec_rec(d);
+    d->len = 0;
+    if (--d->left == 0) {
+        d->in_dump = false;
+    }
+}
+
+static int trace_dec_hex(int ch)
+{
+    if ((ch >= '0') && (ch <= '9')) {
+        return ch - '0';
+    }
+    if ((ch >= 'a') && (ch <= 'f')) {
+        return ch - 'a' + 10;
+    }
+    if ((ch >= 'A') && (ch <= 'F')) {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+static void trace_dec_log(trace_dec_t *d, FILE *f)
+{
+    char line[TRACE_DEC_LINE_MAX];
+    char *p, *hex;
+    int hi, lo;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        p = strstr(line, "TRACE ");
+        if (p == NULL) {
+            continue;
+        }
+        hex = p + 6;
+        /* the label is the text before "TRACE ", trimmed */
+        while ((p > line) && (p[-1] == ' ')) {
+            p--;
+        }
+        *p = '\0';
+        p = hex;
+        for (;;) {
+            hi = trace_dec_hex(p[0]);
+            lo = (hi < 0) ? -1 : trace_dec_hex(p[1]);
+            if (lo < 0) {
+                break;
+            }
+            trace_dec_byte(d, (hi << 4) | lo, line);
+            p += 2;
+        }
+    }
+}
+
+static void trace_dec_bin(trace_dec_t *d, FILE *f)
+{
+    int ch;
+
+    while ((ch = fgetc(f)) != EOF) {
+        trace_dec_byte(d, ch, "");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    trace_dec_t dec;
+    FILE *f;
+    bool log;
+    int i;
+
+    log = false;
+    f = stdin;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-x") == 0) {
+            log = true;
+        } else if ((argv[i][0] != '-') && (f == stdin)) {
+            f = fopen(argv[i], log ? "r" : "rb");
+            if (f == NULL) {
+                perror(argv[i]);
+                return 1;
+            }
+        } else {
+            printf("usage: %s [-x] [file]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    memset(&dec, 0, sizeof(dec));
+    if (log) {
+        trace_dec_log(&dec, f);
+    } else {
+        trace_dec_bin(&dec, f);
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+    if (dec.in_dump) {
+        printf("dump cut short, %u records missing\n", dec.left);
+    }
+    return (dec.dumps > 0) ? 0 : 1;
+}
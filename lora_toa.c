@@ -0,0 +1,39 @@
+#include "lora_toa.h"
+
+uint32_t lora_sym_us(const lora_phy_t *phy)
+{
+    /* 2^sf / bw, 8 us per chip at 125 kHz */
+    return ((uint32_t)1 << phy->sf) * (8 >> phy->bw);
+}
+
+/* low data rate optimization, as the driver turns it on */
+static bool lora_ldro(const lora_phy_t *phy)
+{
+    return ((phy->bw == 0) && (phy->sf >= 11)) || ((phy->bw == 1) && (phy->sf == 12));
+}
+
+uint32_t lora_payload_sym(const lora_phy_t *phy, uint8_t len)
+{
+    int32_t num, den, n;
+
+    num = 8 * len - 4 * phy->sf + 28 + (phy->crc ? 16 : 0) - (phy->fix_len ? 20 : 0);
+    den = 4 * (phy->sf - (lora_ldro(phy) ? 2 : 0));
+    n = (num > 0) ? (num + den - 1) / den * (phy->cr + 4) : 0;
+    return 8 + n;
+}
+
+uint32_t lora_toa_us(const lora_phy_t *phy, uint8_t len)
+{
+    uint32_t tsym;
+
+    tsym = lora_sym_us(phy);
+    return (4 * phy->preamble + 17) * tsym / 4 + lora_payload_sym(phy, len) * tsym;
+}
+
+uint32_t fsk_toa_us(uint32_t bps, uint16_t preamble, bool fix_len, bool crc, uint8_t len)
+{
+    uint32_t bytes;
+
+    bytes = preamble + 3 + (fix_len ? 0 : 1) + len + (crc ? 2 : 0);
+    return (uint32_t)((uint64_t)bytes * 8 * 1000000 / (bps ? bps : 1));
+}
@@ -0,0 +1,29 @@
+#ifndef __LORA_TOA_H
+#define __LORA_TOA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ LoRa time on air, after the SX1276 datasheet (section 4.1.1.7).
+ Settings use the encoding of the SX1276 driver's SetTxConfig.
+ */
+typedef struct {
+    uint8_t sf;                 // 7 to 12
+    uint8_t bw;                 // 0: 125 kHz, 1: 250 kHz, 2: 500 kHz
+    uint8_t cr;                 // 1: 4/5, 2: 4/6, 3: 4/7, 4: 4/8
+    uint16_t preamble;          // programmed preamble symbols, 4.25 are added by the modem
+    bool fix_len;               // implicit header
+    bool crc;
+} lora_phy_t;
+
+/* symbol time in us */
+uint32_t lora_sym_us(const lora_phy_t *phy);
+/* payload symbols for len bytes, the 8 of the header included */
+uint32_t lora_payload_sym(const lora_phy_t *phy, uint8_t len);
+/* time on air in us of a len byte payload */
+uint32_t lora_toa_us(const lora_phy_t *phy, uint8_t len);
+/* FSK: preamble, 3 byte sync word, length byte unless fix_len, payload, CRC, at bps */
+uint32_t fsk_toa_us(uint32_t bps, uint16_t preamble, bool fix_len, bool crc, uint8_t len);
+
+#endif // __LORA_TOA_H
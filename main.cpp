@@ -4,7 +4,12 @@
 
 extern "C"{
     #include "frag.h"
+    #include "frag_rate.h"
+    #include "frag_sched.h"
+    #include "frag_plan.h"
+    #include "evq.h"
     #include "packets.h"
+    #include "trace.h"
 }
 
 /* Set this flag to '1' to display debug messages on the console */
@@ -30,7 +35,7 @@ extern "C"{
                                                                   //  4: 4/8]
     #define LORA_PREAMBLE_LENGTH                        8         // Same for Tx and Rx
     #define LORA_SYMBOL_TIMEOUT                         5         // Symbols
-    #define LORA_FIX_LENGTH_PAYLOAD_ON                  false
+    #define LORA_FIX_LENGTH_PAYLOAD_ON                  false     // true: implicit header, frames are plan.frame_len
     #define LORA_FHSS_ENABLED                           false
     #define LORA_NB_SYMB_HOP                            4
     #define LORA_IQ_INVERSION_ON                        false
@@ -50,8 +55,7 @@ extern "C"{
     #error "Please define a modem in the compiler options."
 #endif
 
-#define RX_TIMEOUT_VALUE                                3500      // in ms
-#define BUFFER_SIZE                                     32        // Define the payload size here
+#define FRAME_MAX_LEN                                   EVQ_DATA_LEN // largest frame, see packets.h
 
 #define SEC_TO_MSEC  (1000)
 
@@ -61,25 +65,33 @@ M == The  initial  data  block  that  needs  to  be  transported  must
      first  be  fragmented  into  M  data 417fragments  of arbitrary  but  equal  length
 N == bytes to be sent
 */
-#define FRAG_NB                 (10) // data block will be divided into 10 fragments
-#define FRAG_SIZE               (19) // each fragment size will be 10 bytes
-// thus data block size is 10 * 10 == 100
-#define FRAG_CR                 (FRAG_NB - 5) // basically M/N
-#define FRAG_PER                (0.3)// changes the lost packet count
-#define FRAG_TOLERENCE          (10 + FRAG_NB * (FRAG_PER + 0.05))
+#define FRAG_BLOCK_LEN          (190) // data block, frag_plan picks the fragment size, nb and cr
+#define FRAG_DEC_RAM            (512) // decoder buffer, the plan stays within it
+#define FRAG_SESSION            (0) // FragIndex of the frames
+#define FRAG_PER                (0.3)// loss rate assumed until the link is measured
+#define FRAG_SIGMA              (2.33) // margin of the coding rate, about 99% of the sessions decode
+#define FRAG_GAP_MS             (10) // between the end of a fragment and the next one
+#define DUTY_CYCLE_PM           (10) // 1% in the 868.0 - 868.6 MHz sub-band
+#define DUTY_CYCLE_WINDOW_MS    (3600000) // ETSI EN 300 220, one hour
 #define LOOP_TIMES              (1)
+#define TRACE_LEN               (64) // records of the trace ring, 16 bytes each
 #define DEBUG
+#ifndef IS_MASTER
 #define IS_MASTER               (0)
+#endif
 
 #if IS_MASTER
 frag_enc_t encobj;
-//uint8_t enc_dt[FRAG_NB * FRAG_SIZE]; // 100 bytes
-uint8_t enc_buf[FRAG_NB * FRAG_SIZE + FRAG_CR * FRAG_SIZE]; //+ FRAG_NB * FRAG_CR]; // //100 + 20 * 10 + 20 * 10 == 500 bytes
+uint8_t enc_buf[FRAG_BLOCK_LEN + FRAME_MAX_LEN]; // data block and the padding of its last fragment
+uint8_t enc_line_buf[FRAG_ENC_LINE_LEN(FRAG_BLOCK_LEN)]; // matrix line scratch of frag_enc_next
+frag_sched_t sched;
+Timer sched_timer;
+Timeout sched_timeout; // posts SEND when the duty cycle allows the next fragment
 
 #else
 frag_dec_t decobj;
-uint8_t dec_buf[(FRAG_NB + FRAG_CR) * FRAG_SIZE ];
-uint8_t dec_flash_buf[(FRAG_NB + FRAG_CR) * FRAG_SIZE];
+bm_t dec_buf[FRAG_DEC_RAM / sizeof(bm_t)]; // word aligned for the bitmaps
+uint8_t dec_flash_buf[FRAG_BLOCK_LEN + FRAME_MAX_LEN];
 #endif
 
 /*
@@ -98,10 +110,20 @@ typedef enum
     TX_TIMEOUT,
 
     CAD,
-    CAD_DONE
+    CAD_DONE,
+
+    SEND
 }AppStates_t;
 
-volatile AppStates_t State = LOWPOWER;
+/* posted by the radio and timer callbacks, handled by radioEvents */
+evq_t evq;
+
+/* per fragment events, dumped once the session is over, see trace_out */
+trace_t trace;
+trace_rec_t trace_buf[TRACE_LEN];
+
+/* nothing needs the us ticker until the next radio interrupt, see radioEvents */
+volatile bool sleep_deep = false;
 
 /*!
  * Radio events function pointer
@@ -114,11 +136,57 @@ RawSerial pc(USBTX, USBRX);
  */
 SX1276MB1xAS Radio( NULL );
 
-uint16_t BufferSize = BUFFER_SIZE;
-uint8_t Buffer[BUFFER_SIZE]; // cast into packet, each packet can be of size 21 bytes
+frag_rate_t rate;
+frag_plan_t plan; // fragment size, nb and cr, the same on both ends
+
+void rate_init(frag_rate_t *rc)
+{
+    frag_rate_cfg_t cfg;
+
+    cfg.loss = FRAG_PER;
+    cfg.burst = 1;
+    cfg.prior = 64;
+    cfg.window = 1024;
+    cfg.cr_min = 1;
+    cfg.cr_max = FRAG_N_MAX;
+    cfg.overhead = 4;
+    cfg.sigma = FRAG_SIGMA;
+#if USE_MODEM_LORA == 1
+    cfg.snr_floor = FRAG_RATE_SNR_FLOOR(LORA_SPREADING_FACTOR);
+    cfg.snr_margin = 5;
+#else
+    cfg.snr_floor = 0;
+    cfg.snr_margin = 0;
+#endif
+    frag_rate_init(rc, &cfg);
+}
 
-int16_t RssiValue = 0.0;
-int8_t SnrValue = 0.0;
+int plan_init(frag_plan_t *p)
+{
+    frag_plan_cfg_t cfg;
+
+    cfg.len = FRAG_BLOCK_LEN;
+#if USE_MODEM_LORA == 1
+    cfg.phy.sf = LORA_SPREADING_FACTOR;
+    cfg.phy.bw = LORA_BANDWIDTH;
+    cfg.phy.cr = LORA_CODINGRATE;
+    cfg.phy.preamble = LORA_PREAMBLE_LENGTH;
+    cfg.phy.fix_len = LORA_FIX_LENGTH_PAYLOAD_ON;
+    cfg.phy.crc = LORA_CRC_ENABLED;
+    cfg.fsk_bps = 0;
+#else
+    cfg.phy.preamble = FSK_PREAMBLE_LENGTH;
+    cfg.phy.fix_len = FSK_FIX_LENGTH_PAYLOAD_ON;
+    cfg.phy.crc = FSK_CRC_ENABLED;
+    cfg.fsk_bps = FSK_DATARATE;
+#endif
+    cfg.overhead = FRAG_WIRE_HDR_LEN;
+    cfg.max_payload = FRAME_MAX_LEN;
+    cfg.ram = FRAG_DEC_RAM;
+    /* the prior loss, both ends plan before any frame */
+    cfg.rc = &rate;
+    return frag_plan(&cfg, p);
+}
 
 #if !IS_MASTER
 int flash_write(uint32_t addr, uint8_t *buf, uint32_t len)
@@ -133,6 +201,20 @@ int flash_read(uint32_t addr, uint8_t *buf, uint32_t len)
     return 0;
 }
 #endif
+/* post an event from a callback or the main loop, masked against the other interrupts */
+void post_event(uint8_t type)
+{
+    evq_ev_t *ev;
+
+    __disable_irq();
+    ev = evq_alloc(&evq);
+    if (ev != NULL) {
+        ev->type = type;
+        evq_post(&evq);
+    }
+    __enable_irq();
+}
+
 void putbuf(uint8_t *buf, int len)
 {
     int i;
@@ -151,146 +233,227 @@ void put_bool_buf(uint8_t *buf, int len)
     debug("\r\n");
 }
 
-void frag_encobj_log(frag_enc_t *encobj)
+/* one line per chunk of the dump, host/trace_dec -x reads them back from the console log */
+void trace_out(void *arg, const uint8_t *buf, uint32_t len)
 {
+    uint32_t i;
 
-    int i;
+    (void)arg;
+    printf("TRACE ");
+    for (i = 0; i < len; i++) {
+        printf("%02X", buf[i]);
+    }
+    printf("\r\n");
+}
+
+#if IS_MASTER
+void frag_encobj_log(frag_enc_t *encobj, uint32_t cr)
+{
+    uint32_t i;
+    uint8_t buf[FRAME_MAX_LEN];
 
     printf("uncoded blocks:\r\n");
-    for (i = 0; i < encobj->num * encobj->unit; i += encobj->unit) {
-        putbuf(encobj->line + i, encobj->unit);
+    for (i = 1; i <= encobj->num; i++) {
+        frag_enc_next(encobj, i, buf);
+        putbuf(buf, encobj->unit);
     }
 
     printf("\ncoded blocks:\r\n");
-    for (i = 0; i < encobj->cr * encobj->unit; i += encobj->unit) {
-        putbuf(encobj->rline + i, encobj->unit);
+    for (i = encobj->num + 1; i <= encobj->num + cr; i++) {
+        frag_enc_next(encobj, i, buf);
+        putbuf(buf, encobj->unit);
     }
+}
 
-    printf("\nmatrix line:\r\n");
-    for (i = 0; i < encobj->num * encobj->cr; i += encobj->num) {
-        put_bool_buf(encobj->mline + i, encobj->num);
+/* post SEND when the duty cycle allows fragment frag_tx + 1 */
+void schedule_fragment(uint16_t frag_tx)
+{
+    uint32_t delay;
+
+    delay = frag_sched_delay(&sched, sched_timer.read_ms());
+    if (delay > FRAG_GAP_MS) {
+        trace_put(&trace, TRACE_TX_WAIT, frag_tx + 1, delay, encobj.num + plan.cr - frag_tx);
+    }
+    if (delay > 0) {
+        sched_timeout.attach_us(&OnSendTimeout, delay * 1000);
+    } else {
+        post_event(SEND);
     }
 }
 
+void send_fragment(uint16_t frag_tx)
+{
+    uint8_t data[FRAME_MAX_LEN];
+    uint8_t frame[FRAME_MAX_LEN];
+    int len;
+
+    frag_enc_next(&encobj, frag_tx + 1, data);
+    len = frag_wire_encode(frame, sizeof(frame), FRAG_SESSION, frag_tx + 1, data, plan.size);
+
+    frag_sched_sent(&sched, sched_timer.read_ms());
+    Radio.Send( frame, len );
+    trace_put(&trace, TRACE_TX, frag_tx + 1, len,
+              frag_sched_eta(&sched, sched_timer.read_ms(), encobj.num + plan.cr - frag_tx - 1));
+}
+#endif
+
 void radioEvents(){
 
     bool isMaster = IS_MASTER;
     uint16_t frag_tx = 0;
+#if IS_MASTER == 0
+    bool traced = false;        // the trace is dumped once, when the session ends
+#endif
+    evq_ev_t *ev;
+
+#if IS_MASTER == 1
+    /* fragments go back to back from the start, TxDone schedules the next one */
+    schedule_fragment(frag_tx);
+#endif
 
     while( 1 )
     {
-        switch( State )
+        /*
+         * sleep until a callback posts an event, with interrupts masked so
+         * that none is posted between the check and the sleep: a pending
+         * interrupt still wakes the core, and runs once they are unmasked
+         */
+        __disable_irq();
+        if( evq_empty( &evq ) )
         {
-        case RX:
-            //rx_count++;
-#if isMaster == 1
-            if( isMaster == true )
+            if( sleep_deep )
             {
-                debug("Master is receiving data\r\n");
+                deepsleep( );
             }
-#elif IS_MASTER == 0
-            if(!isMaster) //slave
+            else
+            {
+                sleep( );
+            }
+        }
+        __enable_irq();
+
+        while( ( ev = evq_peek( &evq ) ) != NULL )
+        {
+            switch( ev->type )
             {
-                if( BufferSize > 0 )
+            case RX:
+                //rx_count++;
+#if isMaster == 1
+                if( isMaster == true )
+                {
+                    debug("Master is receiving data\r\n");
+                }
+#elif IS_MASTER == 0
+                if(!isMaster) //slave
                 {
-                    debug("Data from master\r\n");
-                    dataFrag *packet = (dataFrag*) Buffer;
-                    //putbuf(Buffer, BUFFER_SIZE);
-
-                    debug("seq_num %d\r\n", packet->seqNum);
-                    if(packet->seqNum != frag_tx){
-                        debug("received giberrish(seqNum is %d, should have been %d), dropping corrupt packet\r\n",
-                                packet->seqNum, frag_tx);
+                    if( ev->len > 0 )
+                    {
+                        frag_wire_t frag;
+                        //putbuf(ev->data, ev->len);
+
+                        if(frag_wire_decode(ev->data, ev->len, plan.size, &frag) < 0 || frag.index != FRAG_SESSION){
+                            trace_put(&trace, TRACE_RX_OTHER, ev->len, plan.size, FRAG_SESSION);
+                            break;
+                        }
+                        uint16_t seqNum = frag.n - 1;
+                        trace_put(&trace, TRACE_RX, frag.n, ev->rssi, ev->snr);
+                        if(seqNum < frag_tx){
+                            /* older than the last fragment, a corrupt or replayed frame */
+                            trace_put(&trace, TRACE_RX_OLD, frag.n, frag_tx + 1, ev->len);
+                            break;
+                        }
+                        if(seqNum > frag_tx){
+                            /* frames lost on the air, the decoder recovers them */
+                            trace_put(&trace, TRACE_RX_LOST, frag_tx + 1, seqNum, seqNum - frag_tx);
+                            frag_tx = seqNum;
+                        }
+
                         frag_tx++;
-                        Radio.Rx( RX_TIMEOUT_VALUE );
-                        State = LOWPOWER;
-                        break;
-                    }
-                    putbuf(packet->data, FRAG_SIZE);
-
-                    frag_tx++;
-                    if(packet->seqNum == 8 || packet->seqNum == 5 /*|| packet->seqNum == 42 || packet->seqNum == 30*/
-                        ){
-                        debug("data dropped\r\n");
-                        Radio.Rx( RX_TIMEOUT_VALUE );
-                        State = LOWPOWER;
-                        break;
+                        if(seqNum == 8 || seqNum == 5 /*|| seqNum == 42 || seqNum == 30*/
+                            ){
+                            trace_put(&trace, TRACE_RX_SKIP, frag.n, frag_tx, plan.nb + plan.cr);
+                            break;
+                        }
+
+                        frag_rate_rx(&rate, frag.n, ev->rssi, ev->snr);
+                        int ret = frag_dec(&decobj, frag.n, (uint8_t *)frag.data, decobj.cfg.size);
+                        if (ret == FRAG_DEC_ONGOING) {
+                            frag_dec_status_t st;
+                            frag_dec_status(&decobj, &st);
+                            trace_put(&trace, TRACE_DEC, frag.n, st.rank, st.needed);
+                        } else if (ret >= 0) {
+                            printf("dec complete (reconstruct %d packets)\r\n", ret);
+                            frag_dec_log(&decobj);
+                            printf("link loss %d%%, burst %d.%d, snr %d dB, next session cr %d tol %d\r\n",
+                                   (int)(frag_rate_loss(&rate) * 100),
+                                   (int)frag_rate_burst(&rate), (int)(frag_rate_burst(&rate) * 10) % 10,
+                                   (int)rate.snr,
+                                   frag_rate_cr(&rate, plan.nb),
+                                   frag_rate_tolerence(&rate, plan.nb, frag_rate_cr(&rate, plan.nb)));
+#ifdef FRAG_STATS
+                            printf("dec stats: xor %u B, flash rd %u wr %u, elim %u in %u frames (max %u), "
+                                   "redundant %u, cycles %u / %u / %u\r\n",
+                                   (unsigned)decobj.stats.xor_bytes, (unsigned)decobj.stats.frd_calls,
+                                   (unsigned)decobj.stats.fwr_calls, (unsigned)decobj.stats.elim_steps,
+                                   (unsigned)decobj.stats.coded_frames, (unsigned)decobj.stats.elim_max,
+                                   (unsigned)decobj.stats.redundant, (unsigned)decobj.stats.cyc_uncoded,
+                                   (unsigned)decobj.stats.cyc_coded, (unsigned)decobj.stats.cyc_recon);
+#endif
+                        } else {
+                            printf("dec error %d\r\n", ret);
+                            //frag_dec_log(&decobj);
+                        }
+                        if (ret != FRAG_DEC_ONGOING && !traced) {
+                            printf("trace: %d records\r\n", (int)trace_dump(&trace, trace_out, NULL));
+                            traced = true;
+                        }
                     }
-
-                    int ret = frag_dec(&decobj, packet->seqNum+1, packet->data, decobj.cfg.size);
-                    if (ret == FRAG_DEC_ONGOING) {
-                        //printf("\n");
-                        debug(" decoding ongoing\r\n");
-                    } else if (ret >= 0) {
-                        printf("dec complete (reconstruct %d packets)\r\n", ret);
-                        frag_dec_log(&decobj);
-                        Radio.Rx( RX_TIMEOUT_VALUE );
-                        State = LOWPOWER;
-                        break;
-                    } else {
-                        printf("dec error %d\r\n", ret);
-                        //frag_dec_log(&decobj);
-                        Radio.Rx( RX_TIMEOUT_VALUE );
-                        State = LOWPOWER;
+                }
+#endif
+                break;
+            case TX:
+#if IS_MASTER == 1
+                if( isMaster == true )
+                {
+                    if( frag_tx < encobj.num + plan.cr )
+                    {
+                        schedule_fragment(frag_tx);
                         break;
-
                     }
+                    printf("all %d fragments sent\r\n", frag_tx);
+                    printf("trace: %d records\r\n", (int)trace_dump(&trace, trace_out, NULL));
+                    /* nothing left to send, the radio stays asleep */
+                    sleep_deep = true;
                 }
-            }
 #endif
-            Radio.Rx( RX_TIMEOUT_VALUE );
-            State = LOWPOWER;
-            break;
-        case TX:
-            Radio.Rx( RX_TIMEOUT_VALUE );
-            State = LOWPOWER;
-            break;
-        case RX_TIMEOUT:
+                break;
+            case SEND:
 #if IS_MASTER == 1
-            if( isMaster == true )
-            {
-                if(frag_tx >= encobj.num + encobj.cr){
-                    break;
+                send_fragment(frag_tx++);
+#endif
+                break;
+            case RX_ERROR:
+                debug("RX_ERROR\r\n");
+                /* fall through */
+            case RX_TIMEOUT:
+                if(!isMaster)
+                {
+                    Radio.Rx( 0 );
+                }
+                break;
+            case TX_TIMEOUT:
+#if IS_MASTER == 1
+                /* the fragment is lost for every receiver, go on with the next one */
+                if( frag_tx < encobj.num + plan.cr )
+                {
+                    schedule_fragment(frag_tx);
                 }
-                debug("RX_Timeout... sending data set fragments\r\n");
-                debug("sending fragment:%d: \t", frag_tx);
-
-                dataFrag Frag = {0, {0}};
-                dataFrag *packet = &Frag;
-                packet->seqNum = frag_tx;
-
-                memcpy(packet->data, encobj.line + frag_tx * FRAG_SIZE, FRAG_SIZE);
-                putbuf(encobj.line + frag_tx*FRAG_SIZE, FRAG_SIZE);
-
-                debug("sending packet with seq: %d & data : \t", packet->seqNum);
-                putbuf(packet->data, FRAG_SIZE);
-                wait_ms( 10 );
-                Radio.Send( (uint8_t*)packet, BUFFER_SIZE);
-                frag_tx++;
-            }
 #endif
-            if(!isMaster)
-            {
-                debug("Master(%d): waiting for data \r\n", isMaster);
-                Radio.Rx( RX_TIMEOUT_VALUE );
+                break;
+            default:
+                break;
             }
-            State = LOWPOWER;
-            break;
-        case RX_ERROR:
-            debug("RX_ERROR\r\n");
-            Radio.Rx( RX_TIMEOUT_VALUE );
-            State = LOWPOWER;
-            break;
-        case TX_TIMEOUT:
-            Radio.Rx( RX_TIMEOUT_VALUE );
-            State = LOWPOWER;
-            break;
-        case LOWPOWER:
-            wait_ms(1000);
-            break;
-        default:
-            State = LOWPOWER;
-            break;
+            evq_pop( &evq );
         }
     }
 }
@@ -307,44 +470,63 @@ int main( void )
         }
     }
 
-    int enc_size = (FRAG_NB * FRAG_SIZE + FRAG_CR * FRAG_SIZE + FRAG_NB * FRAG_CR);
-    debug("enc size is %d\r\n", enc_size);
-    //enc_buf = (uint8_t*)malloc(enc_size*sizeof(uint8_t));
+    rate_init(&rate);
+    if (plan_init(&plan) < 0) {
+        printf("no fragment size fits FRAME_MAX_LEN and FRAG_DEC_RAM\r\n");
+        return 1;
+    }
+    printf("plan: %d bytes in %d fragments of %d + %d coded, %d byte frames, %d us on air each, %d ms in all\r\n",
+           FRAG_BLOCK_LEN, plan.nb, plan.size, plan.cr, plan.frame_len, plan.toa_us, (int)(plan.session_us / 1000));
+    evq_init(&evq);
+    trace_init(&trace, trace_buf, TRACE_LEN, us_ticker_read);
 
 #if IS_MASTER == 1
     uint16_t i;
     if(isMaster){
-        for (i = 0; i < FRAG_NB * FRAG_SIZE; i++) {
+        for (i = 0; i < FRAG_BLOCK_LEN; i++) {
             enc_buf[i] = i;
         }
 
 
-        encobj.dt = enc_buf;
-        encobj.maxlen = (FRAG_NB * FRAG_SIZE + FRAG_CR * FRAG_SIZE + FRAG_NB * FRAG_CR);
-        clock_t start, end;
-        //encobj.unit = FRAG_SIZE;
-        //encobj.num = (FRAG_NB*FRAG_SIZE)/FRAG_SIZE;
-       // encobj.cr = FRAG_CR
-        //encobj.line = obj->dt;
-        //encobj.rline = obj->dt + len;
-        //encobj.mline = obj->dt + len + cr * unit;
-        start = clock();
-        int ret = frag_enc(&encobj, enc_buf, FRAG_NB * FRAG_SIZE, FRAG_SIZE, FRAG_CR);
-        end = clock();
-        printf("enc ret %d, maxlen %d, duration %f\r\n", ret, encobj.maxlen, (end - start)/(double)CLOCKS_PER_SEC);
-        frag_encobj_log(&encobj);
+        encobj.dt = enc_line_buf;
+        encobj.maxlen = sizeof(enc_line_buf);
+        encobj.trace = &trace;
+        /* the padding of the last fragment stays zero */
+        int ret = frag_enc_init(&encobj, enc_buf, plan.nb * plan.size, plan.size);
+        printf("enc ret %d, maxlen %d\r\n", ret, encobj.maxlen);
+        if (ret < 0) {
+            printf("the planned block does not fit the encoder\r\n");
+            return 1;
+        }
+
+        frag_sched_cfg_t scfg;
+        scfg.toa_us = plan.toa_us;
+        scfg.duty_pm = DUTY_CYCLE_PM;
+        scfg.window_ms = DUTY_CYCLE_WINDOW_MS;
+        scfg.gap_ms = FRAG_GAP_MS;
+        frag_sched_init(&sched, &scfg);
+        sched_timer.start();
+        /* the receiver's measurement has no way back here, the prior sets the rate */
+        printf("session done in %d ms\r\n", frag_sched_eta(&sched, 0, plan.nb + plan.cr));
+        frag_encobj_log(&encobj, plan.cr);
     }
 #elif IS_MASTER == 0
     if(!isMaster) {
         printf("\n\n-------------------\n");
-        decobj.cfg.dt = dec_buf;
+        decobj.cfg.dt = (uint8_t *)dec_buf;
         decobj.cfg.maxlen = sizeof(dec_buf);
-        decobj.cfg.nb = FRAG_NB;
-        decobj.cfg.size = FRAG_SIZE;
-        decobj.cfg.tolerence = FRAG_TOLERENCE;
+        decobj.cfg.nb = plan.nb;
+        decobj.cfg.size = plan.size;
+        decobj.cfg.tolerence = plan.tolerence;
+        decobj.cfg.faddr = 0;
         decobj.cfg.frd_func = flash_read;
         decobj.cfg.fwr_func = flash_write;
+        decobj.cfg.trace = &trace;
         int len = frag_dec_init(&decobj);
+        if (len < 0) {
+            printf("dec init error %d, the plan does not fit the decoder\r\n", len);
+            return 1;
+        }
         debug("memory cost: %d, nb %d, size %d, tol %d\n",
            len,
            decobj.cfg.nb,
@@ -387,7 +569,7 @@ int main( void )
 
     Radio.SetRxConfig( MODEM_LORA, LORA_BANDWIDTH, LORA_SPREADING_FACTOR,
                          LORA_CODINGRATE, 0, LORA_PREAMBLE_LENGTH,
-                         LORA_SYMBOL_TIMEOUT, LORA_FIX_LENGTH_PAYLOAD_ON, 0,
+                         LORA_SYMBOL_TIMEOUT, LORA_FIX_LENGTH_PAYLOAD_ON, plan.frame_len,
                          LORA_CRC_ENABLED, LORA_FHSS_ENABLED, LORA_NB_SYMB_HOP,
                          LORA_IQ_INVERSION_ON, true );
 
@@ -401,7 +583,7 @@ int main( void )
 
     Radio.SetRxConfig( MODEM_FSK, FSK_BANDWIDTH, FSK_DATARATE,
                          0, FSK_AFC_BANDWIDTH, FSK_PREAMBLE_LENGTH,
-                         0, FSK_FIX_LENGTH_PAYLOAD_ON, 0, FSK_CRC_ENABLED,
+                         0, FSK_FIX_LENGTH_PAYLOAD_ON, plan.frame_len, FSK_CRC_ENABLED,
                          0, 0, false, true );
 
 #else
@@ -412,47 +594,65 @@ int main( void )
 
     debug_if( DEBUG_MESSAGE, "Starting Ping-Pong loop\r\n" );
 
-    Radio.Rx( RX_TIMEOUT_VALUE );
+#if IS_MASTER == 0
+    /* continuous RX without a timeout: no driver timer runs, the MCU sleeps deep between frames */
+    Radio.Rx( 0 );
+    sleep_deep = true;
+#endif
 
     radioEvents();
+    return 0;
 }
 
 void OnTxDone( void )
 {
     Radio.Sleep( );
-    State = TX;
+    post_event( TX );
     //debug_if( DEBUG_MESSAGE, "> OnTxDone\n\r" );
 }
 
 void OnRxDone( uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr )
 {
-    Radio.Sleep( );
-    BufferSize = size;
-    memcpy( Buffer, payload, BufferSize );
-    RssiValue = rssi;
-    SnrValue = snr;
-    State = RX;
+    evq_ev_t *ev;
+
+    /* the radio stays in continuous RX, fragments come back to back */
+    __disable_irq();
+    ev = evq_alloc( &evq );
+    if( ev != NULL )
+    {
+        ev->type = RX;
+        ev->len = ( size < EVQ_DATA_LEN ) ? size : EVQ_DATA_LEN;
+        memcpy( ev->data, payload, ev->len );
+        ev->rssi = rssi;
+        ev->snr = snr;
+        evq_post( &evq );
+    }
+    __enable_irq();
     //debug_if( DEBUG_MESSAGE, "> OnRxDone\n\r" );
 }
 
 void OnTxTimeout( void )
 {
     Radio.Sleep( );
-    State = TX_TIMEOUT;
+    post_event( TX_TIMEOUT );
     //debug_if( DEBUG_MESSAGE, "> OnTxTimeout\n\r" );
 }
 
 void OnRxTimeout( void )
 {
     Radio.Sleep( );
-    Buffer[BufferSize] = 0;
-    State = RX_TIMEOUT;
+    post_event( RX_TIMEOUT );
     //debug_if( DEBUG_MESSAGE, "> OnRxTimeout\n\r" );
 }
 
 void OnRxError( void )
 {
     Radio.Sleep( );
-    State = RX_ERROR;
+    post_event( RX_ERROR );
     //debug_if( DEBUG_MESSAGE, "> OnRxError\n\r" );
 }
+
+void OnSendTimeout( void )
+{
+    post_event( SEND );
+}
@@ -43,6 +43,11 @@ void OnRxTimeout( void );
  */
 void OnRxError( void );
 
+/*!
+ * @brief Function executed when the duty cycle allows the next fragment
+ */
+void OnSendTimeout( void );
+
 /*!
  * @brief Function executed on Radio Fhss Change Channel event
  */
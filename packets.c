@@ -0,0 +1,37 @@
+#include <string.h>
+#include "packets.h"
+
+int frag_wire_encode(uint8_t *buf, int maxlen, uint8_t index, uint16_t n, const uint8_t *data, uint16_t size)
+{
+    uint16_t hdr;
+
+    if ((index > FRAG_WIRE_INDEX_MAX) || (n == 0) || (n > FRAG_WIRE_N_MAX)) {
+        return FRAG_WIRE_ERR_PARAM;
+    }
+    if (maxlen < FRAG_WIRE_LEN(size)) {
+        return FRAG_WIRE_ERR_LEN;
+    }
+    hdr = ((uint16_t)index << 14) | n;
+    buf[0] = (uint8_t)hdr;
+    buf[1] = (uint8_t)(hdr >> 8);
+    memcpy(buf + FRAG_WIRE_HDR_LEN, data, size);
+    return FRAG_WIRE_LEN(size);
+}
+
+int frag_wire_decode(const uint8_t *buf, int len, uint16_t size, frag_wire_t *frag)
+{
+    uint16_t hdr;
+
+    /* a frame of another length belongs to a session of another size */
+    if (len != FRAG_WIRE_LEN(size)) {
+        return FRAG_WIRE_ERR_LEN;
+    }
+    hdr = buf[0] | ((uint16_t)buf[1] << 8);
+    frag->index = hdr >> 14;
+    frag->n = hdr & FRAG_WIRE_N_MAX;
+    if (frag->n == 0) {
+        return FRAG_WIRE_ERR_N;
+    }
+    frag->data = buf + FRAG_WIRE_HDR_LEN;
+    return 0;
+}
@@ -1,10 +1,39 @@
 #ifndef __PACKETS_H__
 #define __PACKETS_H__
 
-typedef struct dataFragment {
-    uint8_t seqNum;
-    uint8_t data[10]; //frag_size
-    uint8_t padding[10]; //since total size is 21.. need to change
-} dataFrag;
+#include <stdint.h>
 
-#endif
\ No newline at end of file
+/*
+ Fragment frame, as the DataFragment command of the LoRaWAN fragmented
+ data block transport:
+
+   IndexAndN  2 bytes, little endian: FragIndex (session, 0..3) in bits
+              15:14, N (fragment number, from 1) in bits 13:0
+   Payload    the size bytes of the fragment, nothing after
+
+ All fragments of a session have the same size, so a frame is
+ FRAG_WIRE_LEN(size) bytes and can go in a fixed length, implicit header
+ LoRa frame when both ends know size.
+ */
+
+#define FRAG_WIRE_HDR_LEN       (2)
+#define FRAG_WIRE_LEN(size)     (FRAG_WIRE_HDR_LEN + (size))
+#define FRAG_WIRE_INDEX_MAX     (3)
+#define FRAG_WIRE_N_MAX         (0x3FFF)
+
+#define FRAG_WIRE_ERR_PARAM     (-1)
+#define FRAG_WIRE_ERR_LEN       (-2)
+#define FRAG_WIRE_ERR_N         (-3)
+
+typedef struct {
+    uint8_t index;              // FragIndex, session
+    uint16_t n;                 // fragment number, from 1, the fcnt of frag_dec
+    const uint8_t *data;        // payload, in the frame
+} frag_wire_t;
+
+/* write the frame of fragment n of session index to buf, returns its length */
+int frag_wire_encode(uint8_t *buf, int maxlen, uint8_t index, uint16_t n, const uint8_t *data, uint16_t size);
+/* parse a frame of fragments of size bytes, returns 0 */
+int frag_wire_decode(const uint8_t *buf, int len, uint16_t size, frag_wire_t *frag);
+
+#endif
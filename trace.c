@@ -0,0 +1,44 @@
+#include "trace.h"
+
+/* the host decoder reads records as 16 packed bytes */
+typedef char trace_rec_len_check[(sizeof(trace_rec_t) == 16) ? 1 : -1];
+
+int trace_init(trace_t *t, trace_rec_t *buf, uint32_t len, trace_clock_t clock)
+{
+    if ((len == 0) || ((len & (len - 1)) != 0)) {
+        return -1;
+    }
+    t->buf = buf;
+    t->mask = len - 1;
+    t->head = 0;
+    t->clock = clock;
+    return 0;
+}
+
+uint32_t trace_dump(trace_t *t, trace_out_t out, void *arg)
+{
+    trace_hdr_t hdr;
+    trace_rec_t rec;
+    uint32_t head, n, i;
+
+    head = t->head;
+    n = (head > t->mask) ? t->mask + 1 : head;
+
+    hdr.magic = TRACE_MAGIC;
+    hdr.rec_len = sizeof(trace_rec_t);
+    hdr.rsvd = 0;
+    hdr.head = head;
+    hdr.count = n;
+    out(arg, (const uint8_t *)&hdr, sizeof(hdr));
+
+    for (i = head - n; i != head; i++) {
+        rec.ts = t->buf[i & t->mask].ts;
+        rec.id = t->buf[i & t->mask].id;
+        rec.rsvd = 0;
+        rec.a = t->buf[i & t->mask].a;
+        rec.b = t->buf[i & t->mask].b;
+        rec.c = t->buf[i & t->mask].c;
+        out(arg, (const uint8_t *)&rec, sizeof(rec));
+    }
+    return n;
+}
@@ -0,0 +1,95 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ Binary trace ring for the hot paths of the codec and the demo. A record
+ is 16 bytes: a timestamp, an event id and three arguments, and nothing is
+ formatted on the device. trace_dump writes the ring out raw, and
+ host/trace_dec.c prints it offline with the formats of TRACE_EVENTS.
+
+ There is one writer and no lock: trace_put is called from the main loop,
+ not from interrupts. It fills the record before it moves head, so the
+ records behind head are complete whenever the ring is dumped or read by
+ a debugger. Once the ring is full the oldest records are overwritten.
+ */
+
+/* id, format of the arguments a, b and c, each taken as an unsigned int */
+#define TRACE_EVENTS(X) \
+    X(TRACE_FRAG_ENC,           "nb %u, size %u, cr %u") \
+    X(TRACE_FRAG_ENC_NOMEM,     "nb %u needs %u bytes of dt, has %u") \
+    X(TRACE_FRAG_DEC_LOST,      "%u fragments lost, tolerence %u, fragment %u refused") \
+    X(TRACE_FRAG_DEC_ERR_1,     "fragment %u: lost row %u of %u not in the lost bitmap") \
+    X(TRACE_FRAG_DEC_DONE,      "%u lost fragments rebuilt, %u useful frames, %u redundant") \
+    X(TRACE_TX,                 "fragment %u, %u bytes, session done in %u ms") \
+    X(TRACE_TX_WAIT,            "fragment %u waits %u ms for the duty cycle, %u left") \
+    X(TRACE_RX,                 "fragment %u, rssi %d, snr %d") \
+    X(TRACE_RX_OTHER,           "%u bytes, not a %u byte fragment of session %u") \
+    X(TRACE_RX_OLD,             "fragment %u, fragment %u or later expected, %u bytes") \
+    X(TRACE_RX_LOST,            "fragments %u to %u lost, %u in all") \
+    X(TRACE_RX_SKIP,            "fragment %u dropped by the demo, %u of %u seen") \
+    X(TRACE_DEC,                "fragment %u, rank %u, %u more needed")
+
+#define TRACE_ENUM(id, fmt)         id,
+enum {
+    TRACE_NONE,
+    TRACE_EVENTS(TRACE_ENUM)
+    TRACE_ID_MAX
+};
+
+typedef struct {
+    uint32_t ts;                // clock of the ring, 0 without one
+    uint8_t id;
+    uint8_t rsvd;
+    uint16_t a;
+    uint32_t b;
+    uint32_t c;
+} trace_rec_t;
+
+typedef uint32_t (*trace_clock_t)(void);
+typedef void (*trace_out_t)(void *arg, const uint8_t *buf, uint32_t len);
+
+typedef struct {
+    volatile trace_rec_t *buf;
+    uint32_t mask;              // records - 1
+    volatile uint32_t head;     // records written since trace_init
+    trace_clock_t clock;        // optional, us_ticker_read on mbed
+} trace_t;
+
+/* a dump is this header, then count records from the oldest, all little endian */
+#define TRACE_MAGIC             (0x43525446) // "FTRC"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t rec_len;           // sizeof(trace_rec_t)
+    uint16_t rsvd;
+    uint32_t head;
+    uint32_t count;
+} trace_hdr_t;
+
+/* len: records in buf, a power of two */
+int trace_init(trace_t *t, trace_rec_t *buf, uint32_t len, trace_clock_t clock);
+/* out gets the header, then one call per record, returns the records dumped */
+uint32_t trace_dump(trace_t *t, trace_out_t out, void *arg);
+
+/* t: NULL when tracing is off */
+static inline void trace_put(trace_t *t, uint8_t id, uint16_t a, uint32_t b, uint32_t c)
+{
+    volatile trace_rec_t *r;
+
+    if (t == NULL) {
+        return;
+    }
+    r = &t->buf[t->head & t->mask];
+    r->ts = (t->clock != NULL) ? t->clock() : 0;
+    r->id = id;
+    r->a = a;
+    r->b = b;
+    r->c = c;
+    /* volatile accesses keep their order, head moves once the record is written */
+    t->head = t->head + 1;
+}
+
+#endif // __TRACE_H
@@ -0,0 +1,105 @@
+#include <string.h>
+#include "xorbuf.h"
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define XOR_X86
+#include <immintrin.h>
+#elif defined __ARM_NEON || defined __ARM_NEON__
+#define XOR_NEON
+#include <arm_neon.h>
+#endif
+
+typedef uintptr_t xw_t;
+
+/* word at a time, memcpy keeps unaligned access legal and compiles to plain loads */
+static void xor_word(uint8_t *des, const uint8_t *src, int len)
+{
+    int i;
+    xw_t a, b;
+
+    for (i = 0; i + (int)sizeof(xw_t) <= len; i += sizeof(xw_t)) {
+        memcpy(&a, des + i, sizeof(xw_t));
+        memcpy(&b, src + i, sizeof(xw_t));
+        a ^= b;
+        memcpy(des + i, &a, sizeof(xw_t));
+    }
+    for (; i < len; i++) {
+        des[i] ^= src[i];
+    }
+}
+
+#if defined XOR_X86
+__attribute__((target("sse2")))
+static void xor_sse2(uint8_t *des, const uint8_t *src, int len)
+{
+    int i;
+    __m128i a, b;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(des + i));
+        b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(des + i), _mm_xor_si128(a, b));
+    }
+    xor_word(des + i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void xor_avx2(uint8_t *des, const uint8_t *src, int len)
+{
+    int i;
+    __m256i a, b, c, d;
+
+    for (i = 0; i + 64 <= len; i += 64) {
+        a = _mm256_loadu_si256((const __m256i *)(des + i));
+        b = _mm256_loadu_si256((const __m256i *)(src + i));
+        c = _mm256_loadu_si256((const __m256i *)(des + i + 32));
+        d = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        _mm256_storeu_si256((__m256i *)(des + i), _mm256_xor_si256(a, b));
+        _mm256_storeu_si256((__m256i *)(des + i + 32), _mm256_xor_si256(c, d));
+    }
+    for (; i + 32 <= len; i += 32) {
+        a = _mm256_loadu_si256((const __m256i *)(des + i));
+        b = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(des + i), _mm256_xor_si256(a, b));
+    }
+    xor_word(des + i, src + i, len - i);
+}
+
+/* written once by xor_resolve, before main and any thread, read only after that */
+static void (*xor_func)(uint8_t *des, const uint8_t *src, int len) = xor_word;
+
+/* at load time, pick the widest kernel the cpu supports */
+__attribute__((constructor))
+static void xor_resolve(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        xor_func = xor_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        xor_func = xor_sse2;
+    }
+}
+
+void xor_buf(uint8_t *des, const uint8_t *src, int len)
+{
+    xor_func(des, src, len);
+}
+#elif defined XOR_NEON
+void xor_buf(uint8_t *des, const uint8_t *src, int len)
+{
+    int i;
+    uint8x16_t a, b;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        a = vld1q_u8(des + i);
+        b = vld1q_u8(src + i);
+        vst1q_u8(des + i, veorq_u8(a, b));
+    }
+    xor_word(des + i, src + i, len - i);
+}
+#else
+void xor_buf(uint8_t *des, const uint8_t *src, int len)
+{
+    xor_word(des, src, len);
+}
+#endif
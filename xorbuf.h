@@ -0,0 +1,15 @@
+#ifndef __XORBUF_H
+#define __XORBUF_H
+
+#include <stdint.h>
+
+/*
+ des[i] ^= src[i] for len bytes, buffers may be at any alignment.
+
+ x86: SSE2 or AVX2, picked at load time before main, so threads only read it
+ ARM with NEON (Cortex-A gateways): NEON, picked at build time
+ others (Cortex-M): native word at a time
+ */
+void xor_buf(uint8_t *des, const uint8_t *src, int len);
+
+#endif // __XORBUF_H